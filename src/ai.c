@@ -1,243 +1,1014 @@
-#include <pebble.h>
+#include "platform.h"
 #include <stdlib.h>
 #include "util.h"
 #include "game.h"
 #include "ai.h"
+#include "tt.h"
+#include "endgame.h"
+#include "eval.h"
+#include "probcut.h"
+#include "stats.h"
 
+//The evaluation tables for a search are picked by the root's empties less this, since its leaves are some plies further on.
+#define EVAL_LOOKAHEAD_EMPTIES 4
 
-//Returns raw heuristic score of the passed board.  -100 to 100.
-static int board_evaluator(char* board)
+//Nodes this shallow are cheaper to search again than to keep in the transposition table.
+#define TT_MIN_DEPTH 2
+
+//Principal variation search.  Below this depth a null window search of a move costs as much as a full one,
+//so one that fails high would be searched twice for nothing.
+#define PVS_MIN_DEPTH 2
+
+//Aspiration windows.  Scores swing between odd and even depths, since the side that moves last looks better,
+//so each iteration's root window is centred on the score of the iteration two before it, give or take this.
+//It widens on the failing side each time the score falls outside it.
+#define ASPIRATION_WINDOW (2 * EVAL_SCALE)
+
+#define SCORE_INFINITY 10000
+#define GAME_WON_SCORE 1000 //Beats any heuristic score.
+
+//Move ordering.  The more often the first move tried is the best one, the more alpha-beta prunes.
+#define ORDER_HASH_MOVE 30000
+#define ORDER_KILLER_1 20000
+#define ORDER_KILLER_2 19000
+#define HISTORY_MAX 8000 //History scores are halved once any square reaches this.
+#define ENDGAME_PARITY_BONUS 16 //Prefer moves into regions with an odd number of empties when solving.
+#if defined(REVERSI_HOST)
+#define FASTEST_FIRST_MIN_DEPTH 4 //Below this depth counting the opponent's replies costs more than it saves.
+#endif
+
+//Static square priorities: corners first, the squares diagonally next to corners (X) and beside them (C) last.
+static const int8_t SQUARE_PRIORITY[BOARD_WIDTH*BOARD_HEIGHT] = {
+  9, 1, 7, 6, 6, 7, 1, 9,
+  1, 0, 2, 3, 3, 2, 0, 1,
+  7, 2, 5, 4, 4, 5, 2, 7,
+  6, 3, 4, 0, 0, 4, 3, 6,
+  6, 3, 4, 0, 0, 4, 3, 6,
+  7, 2, 5, 4, 4, 5, 2, 7,
+  1, 0, 2, 3, 3, 2, 0, 1,
+  9, 1, 7, 6, 6, 7, 1, 9
+};
+
+//Time slicing.  ai_continue_search runs the search for one slice and then returns, so the
+//event loop keeps running while the AI thinks.
+#define TIME_CHECK_INTERVAL 255 //Check the clock every 256 nodes, often enough to end a slice near AI_SLICE_MS on Aplite.
+#define AI_SLICE_MS 40
+#define AI_SLICE_NODES 4096
+
+//Search results
+#define SEARCH_RUNNING 0
+#define SEARCH_DONE 1
+#define SEARCH_SUSPENDED 2 //Out of slice.  Call again to carry on from the same node.
+#define SEARCH_ABORTED 3 //Out of budget or told to stop.  The current iteration is thrown away.
+
+//Endgame solve stages.  The heuristic search gets the first 1/ENDGAME_FALLBACK_SHARE of the budget, so there's a
+//decent move to play if the solve runs out of time.  The solve then proves the win/loss/draw with a null window,
+//and narrows that down to the exact score with more null window passes (MTD(f)) that reuse each other's table entries.
+#define ENDGAME_FALLBACK_SHARE 8
+#define SOLVE_OFF 0
+#define SOLVE_WLD 1
+#define SOLVE_EXACT 2
+#define SOLVE_DONE 3
+
+//Exact scores share the transposition table with heuristic ones, so they're stored under different keys.
+#define ENDGAME_HASH_KEY 0x456e6467616d6521ULL // "Endgame!"
+
+//Frame states
+#define FRAME_ENTER 0
+#define FRAME_NEXT_MOVE 1
+#define FRAME_AFTER_MOVE 2
+#define FRAME_AFTER_PASS 3
+#define FRAME_AFTER_SCOUT 4 //The move below was searched with a null window, and may need searching again.
+#define FRAME_PROBCUT_HIGH 5 //The frame below is a shallow search of this same position, testing for a fail high.
+#define FRAME_PROBCUT_LOW 6 //Likewise, testing for a fail low.
+
+//One node of the search.  The search walks an explicit stack of these instead of recursing,
+//so it can stop at any node and pick up again on the next slice, and its depth is bounded by the arena it lives in.
+typedef struct {
+  MoveUndo undo; //The move being searched below this frame.
+  int8_t move_list[MAX_MOVES];
+  int16_t keys[MAX_MOVES];
+  int8_t move_count;
+  int8_t move_number; //Next entry of move_list to search.
+  int8_t depth;
+  int8_t state;
+  int8_t best_index;
+  int8_t hash_move;
+  int16_t alpha;
+  int16_t beta;
+  int16_t alpha_orig;
+  int16_t best_score;
+  int8_t killers[2]; //Two moves at this ply that recently caused a cutoff.  Unlike the rest, they outlast the node.
+} SearchFrame;
+
+//The search arena, one frame per ply (see SEARCH_ARENA_BYTES).  A frame in the last one has no room below it for children.
+#define SEARCH_FRAMES ((int)(SEARCH_ARENA_BYTES / sizeof(SearchFrame)))
+
+//The state of one search, down to its move ordering.  It's per thread on the host, where several can run at once (see smp.h).
+static SEARCH_LOCAL SearchFrame s_frames[SEARCH_FRAMES];
+static SEARCH_LOCAL int s_frame_top = -1; //Index of the frame being searched, which is also its ply.  -1 between iterations.
+static SEARCH_LOCAL int s_frame_high_water = 0;
+
+//Iterative deepening.  Each iteration searches s_depth_step plies deeper; the last completed one supplies the move.
+static SEARCH_LOCAL Position s_search_pos;
+static SEARCH_LOCAL uint32_t s_search_start_ms;
+static SEARCH_LOCAL uint32_t s_budget_ms; //0 means no deadline.
+static SEARCH_LOCAL uint32_t s_search_nodes;
+static SEARCH_LOCAL bool s_slicing;
+static SEARCH_LOCAL uint32_t s_slice_start_ms;
+static SEARCH_LOCAL uint32_t s_slice_start_nodes;
+static SEARCH_LOCAL int s_search_depth; //Depth of the last completed heuristic iteration.
+static SEARCH_LOCAL int s_search_score; //And its score.
+static SEARCH_LOCAL int s_iteration_depth; //Depth of the iteration being searched.
+static SEARCH_LOCAL int s_depth_step = 1; //How much deeper each iteration goes than the last.
+static SEARCH_LOCAL int s_search_max_depth;
+static SEARCH_LOCAL int s_search_best_move;
+static SEARCH_LOCAL int s_root_score;
+static SEARCH_LOCAL bool s_stop_requested;
+static SEARCH_LOCAL int s_solve_stage; //Stage of the next iteration, or SOLVE_OFF for a plain iterative deepening search.
+static SEARCH_LOCAL bool s_solving; //True while the current iteration is an exact solve rather than a heuristic search.
+static SEARCH_LOCAL int s_solve_lower; //What the solve has proven about the root score so far.
+static SEARCH_LOCAL int s_solve_upper;
+static SEARCH_LOCAL int s_window_alpha; //Root window for the next heuristic iteration.
+static SEARCH_LOCAL int s_window_beta;
+static SEARCH_LOCAL int s_window_delta;
+static SEARCH_LOCAL int s_iteration_scores[2]; //Root scores of the last odd and even depth iterations.
+static SEARCH_LOCAL int s_iteration_parities; //Bit 0 set once an even depth iteration has finished, bit 1 an odd one.
+static SEARCH_LOCAL int s_features = AI_FEATURES_ALL;
+static SEARCH_LOCAL int s_depth_limit = 0; //0 means no limit.
+static SEARCH_LOCAL int s_selectivity; //ProbCut level, 0 for none.
+#if defined(REVERSI_HOST)
+static SEARCH_LOCAL const bool *s_shared_stop; //Set by another thread to stop this one's search, or NULL.
+#endif
+#if AI_STATS
+static SEARCH_LOCAL SearchStats s_stats;
+#endif
+
+//How many sigmas a ProbCut prediction has to clear at each selectivity level, in tenths.
+static const uint8_t PROBCUT_THRESHOLDS[PROBCUT_LEVELS] = {0, 26, 20, 15, 10};
+
+//How often each square has caused a cutoff anywhere.  The killers per ply are in the frames.
+static SEARCH_LOCAL int16_t s_history[BOARD_WIDTH*BOARD_HEIGHT];
+
+
+//Forget last move's killers and fade its history, which is still a decent guess for this move.
+static void reset_move_ordering()
+{
+  for(int ply = 0; ply < SEARCH_FRAMES; ply++)
+  {
+    s_frames[ply].killers[0] = TT_NO_MOVE;
+    s_frames[ply].killers[1] = TT_NO_MOVE;
+  }
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+  {
+    s_history[i] /= 2;
+  }
+}
+
+static void record_cutoff(int index, int ply, int depth)
+{
+  int8_t *killers = s_frames[ply].killers;
+  if(killers[0] != index)
+  {
+    killers[1] = killers[0];
+    killers[0] = index;
+  }
+  s_history[index] += depth * depth;
+  if(s_history[index] >= HISTORY_MAX)
+  {
+    for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+    {
+      s_history[i] /= 2;
+    }
+  }
+}
+
+//How many replies the opponent would have after index is played.  Fewer is better for us.
+//Works on copies of the bitboards, since a full make_move would also update the hash and counts.
+static int count_replies(const Position *pos, int index)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  uint64_t flips = bitboard_get_flips(own, opp, index);
+  return bitboard_count(bitboard_get_moves(opp ^ flips, own ^ flips ^ (1ULL << index)));
+}
+
+//Fills move_list with the moves in the mask and keys with how promising each one looks.  Returns the move count.
+static int order_moves(Position *pos, uint64_t moves, int ply, int depth, int hash_move, int8_t *move_list, int16_t *keys)
+{
+  int count = 0;
+  uint64_t odd_regions = 0;
+  if(s_solving)
+  {
+    odd_regions = endgame_get_odd_regions(~(pos->discs[0] | pos->discs[1]));
+  }
+  while(moves)
+  {
+    int index = __builtin_ctzll(moves);
+    moves &= moves - 1;
+    int key = s_history[index] + SQUARE_PRIORITY[index];
+    if(index == hash_move)
+    {
+      key = ORDER_HASH_MOVE;
+    }
+    else if(index == s_frames[ply].killers[0])
+    {
+      key = ORDER_KILLER_1;
+    }
+    else if(index == s_frames[ply].killers[1])
+    {
+      key = ORDER_KILLER_2;
+    }
+    else if(s_solving)
+    {
+      //Solving: fastest first, then parity.  History from the heuristic search says little this close to the end.
+      key = SQUARE_PRIORITY[index] - 16 * count_replies(pos, index);
+      if(odd_regions & (1ULL << index))
+      {
+        key += ENDGAME_PARITY_BONUS;
+      }
+    }
+#if defined(REVERSI_HOST)
+    else if(depth >= FASTEST_FIRST_MIN_DEPTH)
+    {
+      //Fastest first: prefer moves that leave the opponent few replies.
+      key -= 16 * count_replies(pos, index);
+    }
+#endif
+    move_list[count] = index;
+    keys[count] = key;
+    count++;
+  }
+  return count;
+}
+
+//Swaps the most promising of the remaining moves into position start and returns it.
+//Picking one at a time is cheaper than a full sort when an early move prunes the rest.
+static int pick_next_move(int8_t *move_list, int16_t *keys, int count, int start)
 {
-  // heuristic:  Add value for sides pieces?
-  // heuristic:  Add value for having more options, reduce value for fewer? 
-  const int CORNER_BONUS = 100;
-  int loc_black_score = 0;
-  int loc_white_score = 0;
+  int best = start;
+  for(int i = start + 1; i < count; i++)
+  {
+    if(keys[i] > keys[best])
+    {
+      best = i;
+    }
+  }
+  int8_t index = move_list[best];
+  int16_t key = keys[best];
+  move_list[best] = move_list[start];
+  keys[best] = keys[start];
+  move_list[start] = index;
+  keys[start] = key;
+  return index;
+}
 
-  get_board_score(board, &loc_black_score, &loc_white_score);
-  int top_right = get_board_index(0,7);
-  int bottom_left =  get_board_index(7,0);
-  int bottom_right =  get_board_index(7,7);
+//Score for the side to move, which is what negamax works with.
+static int relative_evaluator(const Position *pos)
+{
+  return eval_position(pos);
+}
+
+//An exact solve's stand-in for a position the arena has no room to solve: the evaluation as a disc count.
+//No arena the solve ever needs is that small, so it's only ever a last resort.
+static int get_capped_solve_score(const Position *pos)
+{
+  int score = relative_evaluator(pos) / EVAL_SCALE;
+  return min(max(score, -ENDGAME_MAX_SCORE), ENDGAME_MAX_SCORE);
+}
+
+//Called every TIME_CHECK_INTERVAL+1 nodes to decide whether the search may carry on.
+static int check_search_clock()
+{
+#if defined(REVERSI_HOST)
+  if(s_shared_stop != NULL && __atomic_load_n(s_shared_stop, __ATOMIC_RELAXED))
+  {
+    return SEARCH_ABORTED;
+  }
+#endif
+  uint32_t now = get_time_ms();
+  //The first iteration always finishes, so there is always a move to play.
+  if(s_search_depth > 0 && (s_stop_requested || (s_budget_ms > 0 && now - s_search_start_ms >= s_budget_ms)))
+  {
+    return SEARCH_ABORTED;
+  }
+  if(s_slicing && (now - s_slice_start_ms >= AI_SLICE_MS || s_search_nodes - s_slice_start_nodes >= AI_SLICE_NODES))
+  {
+    return SEARCH_SUSPENDED;
+  }
+  return SEARCH_RUNNING;
+}
+
+static void push_frame(int depth, int alpha, int beta)
+{
+  SearchFrame *frame = &s_frames[++s_frame_top];
+  frame->state = FRAME_ENTER;
+  frame->depth = depth;
+  frame->alpha = alpha;
+  frame->beta = beta;
+  s_frame_high_water = max(s_frame_high_water, s_frame_top);
+}
+
+//Transposition table key for the current position and kind of search.
+static uint64_t get_search_key(const Position *pos)
+{
+  return s_solving ? (pos->hash ^ ENDGAME_HASH_KEY) : pos->hash;
+}
+
+static void store_frame_result(SearchFrame *frame, Position *pos)
+{
+  if(frame->depth >= TT_MIN_DEPTH)
+  {
+    int bound = TT_BOUND_EXACT;
+    if(frame->best_score <= frame->alpha_orig)
+    {
+      bound = TT_BOUND_UPPER;
+    }
+    else if(frame->best_score >= frame->beta)
+    {
+      bound = TT_BOUND_LOWER;
+    }
+    tt_store(get_search_key(pos), frame->depth, bound, frame->best_score, frame->best_index);
+  }
+}
 
-  // heuristic:  Add value for corners
-  if(board[0] == BLACK)
+//Generates the frame's moves, or settles its value if it has none.  Returns true in the latter case, with the value in *value.
+static bool expand_frame(SearchFrame *frame, int ply, Position *pos, int *value)
+{
+  // Solving: can the opponent's stable discs alone keep us at or below alpha?
+  if(s_solving && ply > 0 && endgame_stability_cutoff(pos, frame->alpha, value))
   {
-    loc_black_score += CORNER_BONUS;
+    return true;
   }
-  if(board[top_right] == BLACK)
+  uint64_t moves = 0;
+  int status = get_move_status(pos, &moves);
+  if(status == MOVES_GAME_OVER && s_solving)
   {
-    loc_black_score += CORNER_BONUS;
+    *value = endgame_final_score(pos);
+    return true;
   }
-  if(board[bottom_left] == BLACK)
+  if(status == MOVES_GAME_OVER)
   {
-    loc_black_score += CORNER_BONUS;
+    // Game over! 1000 for a win, -1000 for a loss, 0 for a tie.
+    int own_score = pos->disc_count[pos->player];
+    int opp_score = pos->disc_count[toggle_player(pos->player)];
+    *value = 0;
+    if(own_score > opp_score)
+    {
+      *value = GAME_WON_SCORE;
+    }
+    else if(opp_score > own_score)
+    {
+      *value = -GAME_WON_SCORE;
+    }
+    return true;
   }
-  if(board[bottom_right] == BLACK)
+  if(status == MOVES_MUST_PASS)
   {
-    loc_black_score += CORNER_BONUS;
+    // The current board position is a Skip.  It still uses up a ply, except when solving, where depth is the empty square count.
+    make_move(pos, PASS_MOVE, &frame->undo);
+    frame->state = FRAME_AFTER_PASS;
+    push_frame(s_solving ? frame->depth : frame->depth - 1, -frame->beta, -frame->alpha);
+    return false;
   }
-  if(board[0] == WHITE)
+  frame->alpha_orig = frame->alpha;
+  frame->best_score = -SCORE_INFINITY;
+  frame->best_index = TT_NO_MOVE;
+  frame->move_count = order_moves(pos, moves, ply, frame->depth, frame->hash_move, frame->move_list, frame->keys);
+  frame->move_number = 0;
+  frame->state = FRAME_NEXT_MOVE;
+  return false;
+}
+
+//The frame's ProbCut prediction, or NULL if it shouldn't try one.  The root and exact solves always search in full.
+static const ProbCut *get_probcut(SearchFrame *frame, int ply, const Position *pos)
+{
+  if(s_selectivity == 0 || s_solving || ply == 0 || frame->depth < PROBCUT_MIN_DEPTH || frame->depth > PROBCUT_MAX_DEPTH)
   {
-    loc_white_score += CORNER_BONUS;
+    return NULL;
   }
-  if(board[top_right] == WHITE)
+  const ProbCut *cut = &PROBCUT_TABLE[eval_get_phase(pos->empties)][frame->depth - PROBCUT_MIN_DEPTH];
+  return (cut->shallow_depth > 0) ? cut : NULL;
+}
+
+//The shallow search score that predicts a deep one past target, sigmas above it for a fail high (sign 1) or below it
+//for a fail low (sign -1).
+static int get_probcut_bound(const ProbCut *cut, int target, int sign)
+{
+  int margin = sign * (PROBCUT_THRESHOLDS[s_selectivity] * cut->sigma) / 10;
+  return ((target + margin - cut->offset) * PROBCUT_SLOPE_SCALE) / cut->slope;
+}
+
+//Starts a null window shallow search of the frame's own position, at the bound for a fail high or low as state says.
+//Returns false if there's nothing to test, or the bound is out of the heuristic scores' reach.
+static bool start_probcut(SearchFrame *frame, int ply, const Position *pos, int state)
+{
+  const ProbCut *cut = get_probcut(frame, ply, pos);
+  if(cut == NULL)
   {
-    loc_white_score += CORNER_BONUS;
+    return false;
   }
-  if(board[bottom_left] == WHITE)
+  if(state == FRAME_PROBCUT_HIGH)
   {
-    loc_white_score += CORNER_BONUS;
+    int bound = get_probcut_bound(cut, frame->beta, 1);
+    if(bound > EVAL_LIMIT)
+    {
+      return false;
+    }
+    frame->state = state;
+    push_frame(cut->shallow_depth, bound - 1, bound);
   }
-  if(board[bottom_right] == WHITE)
+  else
   {
-    loc_white_score += CORNER_BONUS;
+    int bound = get_probcut_bound(cut, frame->alpha, -1);
+    if(bound < -EVAL_LIMIT)
+    {
+      return false;
+    }
+    frame->state = state;
+    push_frame(cut->shallow_depth, bound, bound + 1);
   }
-  
-  return loc_black_score - loc_white_score;
+  return true;
 }
-//Returns min or max value of the passed board based on current_player
-int min_max_evaluator(char* board, int cur_depth, int current_player, int alpha, int beta, int *selection_index)
+
+//Takes in the score of a ProbCut shallow search.  Returns true if the frame is finished, with its value in *value:
+//cut, since a deep search would all but surely fail the same way, or settled while generating its moves.
+static bool probcut_returned(SearchFrame *frame, int ply, Position *pos, int score, int *value)
 {
-  //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d Checking board with alpha: %d and beta: %d at depth %d", current_player, alpha, beta, cur_depth);
-  const bool RANDOMIZE_EQUIVALENT_MOVES = true;
-  int black_score = 0;
-  int white_score = 0;
-  int selectables = set_board_selectables_and_score(board, &black_score, &white_score, current_player);
-  if(selectables==0)
+  const ProbCut *cut = get_probcut(frame, ply, pos);
+  if(frame->state == FRAME_PROBCUT_HIGH)
   {
-    //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d passes!  No selectables", current_player);
+    if(score >= get_probcut_bound(cut, frame->beta, 1))
+    {
+      *value = frame->beta;
+      return true;
+    }
+    if(start_probcut(frame, ply, pos, FRAME_PROBCUT_LOW))
+    {
+      return false;
+    }
+  }
+  else if(score <= get_probcut_bound(cut, frame->alpha, -1))
+  {
+    *value = frame->alpha;
+    return true;
+  }
+  //The shallow search may have left a move to try first.
+  if(frame->hash_move == TT_NO_MOVE)
+  {
+    TTEntry entry;
+    bool found = tt_probe(get_search_key(pos), &entry);
+    STATS_COUNT(s_stats, tt_probes);
+    STATS_COUNT_IF(s_stats, tt_hits, found);
+    if(found)
+    {
+      frame->hash_move = entry.move;
+    }
+  }
+  return expand_frame(frame, ply, pos, value);
+}
 
-    //No choices. It's a skip or a game over.
-    selectables = set_board_selectables_and_score(board, &black_score, &white_score, toggle_player(current_player));
-    if(selectables==0)
+//Sets up a frame that was just pushed.  Returns true if the node's value is already known, in *value.
+static bool enter_frame(SearchFrame *frame, int ply, Position *pos, int *value)
+{
+  if(s_solving && ply > 0 && pos->empties <= ENDGAME_SHALLOW_EMPTIES)
+  {
+    STATS_COUNT(s_stats, evals);
+    *value = endgame_solve(pos, frame->alpha, frame->beta);
+    return true;
+  }
+  if(frame->depth == 0)
+  {
+    STATS_COUNT(s_stats, evals);
+    *value = relative_evaluator(pos);
+    return true;
+  }
+  //Out of arena: score the position as it stands rather than search past the end.  Iterative deepening never asks
+  //for this much, but passes and ProbCut's shallow searches take frames without going a ply deeper.
+  if(s_frame_top == SEARCH_FRAMES - 1)
+  {
+    STATS_COUNT(s_stats, evals);
+    *value = s_solving ? get_capped_solve_score(pos) : relative_evaluator(pos);
+    return true;
+  }
+  // Transposed into a position we've already searched deep enough?  The root always searches, since it has to pick a move.
+  frame->hash_move = TT_NO_MOVE;
+  if(frame->depth >= TT_MIN_DEPTH)
+  {
+    TTEntry entry;
+    bool found = tt_probe(get_search_key(pos), &entry);
+    STATS_COUNT(s_stats, tt_probes);
+    STATS_COUNT_IF(s_stats, tt_hits, found);
+    if(found)
     {
-      // Game over! return 100 for a black win, -100 for a white win, 0 for a tie.
-      if(black_score > white_score)
-      {
-        return 1000;
-      }
-      else if(white_score > black_score)
+      frame->hash_move = entry.move;
+    }
+    if(found && ply > 0 && entry.depth >= frame->depth)
+    {
+      if(entry.bound == TT_BOUND_EXACT ||
+         (entry.bound == TT_BOUND_LOWER && entry.score >= frame->beta) ||
+         (entry.bound == TT_BOUND_UPPER && entry.score <= frame->alpha))
       {
-        return -1000;
+        *value = entry.score;
+        return true;
       }
-      else
+    }
+  }
+  if(start_probcut(frame, ply, pos, FRAME_PROBCUT_HIGH))
+  {
+    return false;
+  }
+  return expand_frame(frame, ply, pos, value);
+}
+
+//Takes in the score of the move just searched.  Returns true if the frame is finished, with its value in *value.
+static bool child_returned(SearchFrame *frame, int ply, Position *pos, int score, int *value)
+{
+  const bool RANDOMIZE_EQUIVALENT_MOVES = true;
+  int index = frame->undo.index;
+  if(score > frame->best_score)
+  {
+    frame->best_score = score;
+    frame->best_index = index;
+    if(score > frame->alpha && ply > 0)
+    {
+      frame->alpha = score;
+    }
+    if(score >= frame->beta)
+    {
+      //Prune: the opponent already has a better option than letting us get here.
+      STATS_COUNT_CUTOFF(s_stats, frame->move_number - 1);
+      record_cutoff(index, ply, frame->depth);
+      store_frame_result(frame, pos);
+      *value = frame->best_score;
+      return true;
+    }
+  }
+  else if(ply == 0 && score == frame->best_score && RANDOMIZE_EQUIVALENT_MOVES && flip_coin())
+  {
+    //Ties at the root are broken at random.
+    frame->best_index = index;
+  }
+  frame->state = FRAME_NEXT_MOVE;
+  return false;
+}
+
+//The score a move has to beat to matter.  At the root it's one below the best so far, so a tie shows up as an exact score.
+static int get_move_floor(SearchFrame *frame, int ply)
+{
+  if(ply == 0)
+  {
+    return max(frame->alpha, frame->best_score - 1);
+  }
+  return frame->alpha;
+}
+
+//Starts the frame's next move.  Returns true instead if it has none left, with its value in *value.
+static bool next_move(SearchFrame *frame, int ply, Position *pos, int *value)
+{
+  if(frame->move_number >= frame->move_count)
+  {
+    store_frame_result(frame, pos);
+    *value = frame->best_score;
+    return true;
+  }
+  int index = pick_next_move(frame->move_list, frame->keys, frame->move_count, frame->move_number);
+  frame->move_number++;
+  make_move(pos, index, &frame->undo);
+  int floor = get_move_floor(frame, ply);
+  //Principal variation search: the first move gets the whole window.  The rest are expected to be worse,
+  //which a null window proves more cheaply; one that turns out better is searched again in run_search.
+  if((s_features & AI_FEATURE_PVS) && frame->move_number > 1 && frame->depth >= PVS_MIN_DEPTH && frame->beta - floor > 1)
+  {
+    frame->state = FRAME_AFTER_SCOUT;
+    push_frame(frame->depth - 1, -floor - 1, -floor);
+  }
+  else
+  {
+    frame->state = FRAME_AFTER_MOVE;
+    push_frame(frame->depth - 1, -frame->beta, -floor);
+  }
+  return false;
+}
+
+static inline bool is_probcut_frame(const SearchFrame *frame)
+{
+  return frame->state == FRAME_PROBCUT_HIGH || frame->state == FRAME_PROBCUT_LOW;
+}
+
+//Fail-soft alpha-beta negamax over the explicit frame stack, starting from (or resuming at) the top frame.
+//Moves are made and unmade on s_search_pos, so it is back where it started once the search is done or aborted.
+static int run_search()
+{
+  Position *pos = &s_search_pos;
+  int value = 0;
+  while(true)
+  {
+    SearchFrame *frame = &s_frames[s_frame_top];
+    bool finished = false;
+    if(frame->state == FRAME_ENTER)
+    {
+      if((++s_search_nodes & TIME_CHECK_INTERVAL) == 0)
       {
-        return 0;
+        int result = check_search_clock();
+        if(result == SEARCH_SUSPENDED)
+        {
+          s_search_nodes--; //Counted again when we resume.
+          return result;
+        }
+        if(result == SEARCH_ABORTED)
+        {
+          //Unwind every frame's move so the position is back at the root.
+          while(--s_frame_top >= 0)
+          {
+            if(!is_probcut_frame(&s_frames[s_frame_top]))
+            {
+              unmake_move(pos, &s_frames[s_frame_top].undo);
+            }
+          }
+          return result;
+        }
       }
+      finished = enter_frame(frame, s_frame_top, pos, &value);
     }
     else
     {
-      // The current board position is a Skip. 
-      if(cur_depth == 0)
+      finished = next_move(frame, s_frame_top, pos, &value);
+    }
+    //Hand finished frames' values up the stack until one of them has more to search.
+    while(finished)
+    {
+      if(--s_frame_top < 0)
       {
-        return board_evaluator(board);
+        s_root_score = value;
+        return SEARCH_DONE;
+      }
+      SearchFrame *parent = &s_frames[s_frame_top];
+      if(is_probcut_frame(parent))
+      {
+        //The shallow search was of the parent's own position, so there's no move to take back or score to negate.
+        finished = probcut_returned(parent, s_frame_top, pos, value, &value);
+        continue;
+      }
+      unmake_move(pos, &parent->undo);
+      if(parent->state == FRAME_AFTER_PASS)
+      {
+        value = -value;
+      }
+      else if(parent->state == FRAME_AFTER_SCOUT && -value > get_move_floor(parent, s_frame_top) && -value < parent->beta)
+      {
+        //The null window failed high, so the move may be the new best.  Search it again for its real score.
+        make_move(pos, parent->undo.index, &parent->undo);
+        parent->state = FRAME_AFTER_MOVE;
+        push_frame(parent->depth - 1, -parent->beta, -get_move_floor(parent, s_frame_top));
+        finished = false;
       }
       else
       {
-        return min_max_evaluator(board, cur_depth-1, toggle_player(current_player), alpha, beta, selection_index);
+        finished = child_returned(parent, s_frame_top, pos, -value, &value);
       }
     }
   }
-  int return_score = 0;
-  // For our purposes, -infinity and infinity.
-  if(get_player_char(current_player) == BLACK)
+}
+
+static void start_iteration(int depth, int alpha, int beta)
+{
+  s_frame_top = -1;
+  push_frame(depth, alpha, beta);
+}
+
+//Returns the value of the passed board from black's point of view (positive is good for black),
+//searching cur_depth plies past the current player's move.  The best move goes in selection_index.
+//Runs to completion without time slicing.  The board itself is not modified.
+int min_max_evaluator(char* board, int cur_depth, int current_player, int alpha, int beta, int *selection_index)
+{
+  board_to_position(board, current_player, &s_search_pos);
+  eval_set_phase(s_search_pos.empties - EVAL_LOOKAHEAD_EMPTIES);
+  tt_new_search();
+  reset_move_ordering();
+  s_budget_ms = 0;
+  s_slicing = false;
+  s_stop_requested = false;
+  s_solving = false;
+  s_selectivity = 0;
+#if defined(REVERSI_HOST)
+  s_shared_stop = NULL;
+#endif
+  //Negamax scores are relative to the side to move.
+  if(current_player == 0)
+  {
+    start_iteration(cur_depth+1, alpha, beta);
+  }
+  else
+  {
+    start_iteration(cur_depth+1, -beta, -alpha);
+  }
+  run_search();
+  *selection_index = (s_frames[0].best_index == TT_NO_MOVE) ? 0 : s_frames[0].best_index;
+  return (current_player == 0) ? s_root_score : -s_root_score;
+}
+
+//Time budget for one move.  Book-like opening moves get little, the midgame gets the most.
+int get_move_budget_ms(int strength, int empties)
+{
+  static const int LEVEL_BUDGETS[4] = {AI_BUDGET_EASY_MS, AI_BUDGET_NORMAL_MS, AI_BUDGET_HARD_MS, AI_BUDGET_BRUTAL_MS};
+  int budget = LEVEL_BUDGETS[min(max(strength, 0), 3)];
+  if(empties > 45)
+  {
+    return budget / 2;
+  }
+  else if(empties > 20)
+  {
+    return (budget * 3) / 2;
+  }
+  return budget;
+}
+
+int get_move_selectivity(int strength)
+{
+  static const int LEVEL_SELECTIVITY[4] = {AI_SELECTIVITY_EASY, AI_SELECTIVITY_NORMAL, AI_SELECTIVITY_HARD, AI_SELECTIVITY_BRUTAL};
+  return LEVEL_SELECTIVITY[min(max(strength, 0), 3)];
+}
+
+static void prepare_search(const Position *pos, int budget_ms, int selectivity)
+{
+  s_search_pos = *pos;
+  s_search_start_ms = get_time_ms();
+  s_budget_ms = budget_ms;
+  s_selectivity = min(max(selectivity, 0), PROBCUT_LEVELS - 1);
+  s_search_nodes = 0;
+  s_search_depth = 0;
+  s_search_score = 0;
+  s_depth_step = 1;
+  s_iteration_parities = 0;
+  s_search_best_move = 0;
+  s_stop_requested = false;
+  s_frame_top = -1;
+  s_frame_high_water = 0;
+  //Searching past the last empty square adds nothing.  With only one move there's nothing to decide.
+  uint64_t moves = 0;
+  get_move_status(pos, &moves);
+  s_search_max_depth = min(pos->empties, SEARCH_FRAMES - 1);
+  if(s_depth_limit > 0)
+  {
+    s_search_max_depth = min(s_search_max_depth, s_depth_limit);
+  }
+  if(bitboard_count(moves) <= 1)
+  {
+    s_search_max_depth = 1;
+  }
+  s_solve_stage = SOLVE_OFF;
+  s_solving = false;
+  s_solve_lower = -ENDGAME_MAX_SCORE;
+  s_solve_upper = ENDGAME_MAX_SCORE;
+  s_window_alpha = ALPHA_MIN;
+  s_window_beta = BETA_MAX;
+  s_window_delta = ASPIRATION_WINDOW;
+  //Close enough to the end to play perfectly?  A depth limited search stays a heuristic one to its depth.
+  if(pos->empties <= ENDGAME_SOLVE_EMPTIES && s_search_max_depth > 1 && s_depth_limit == 0)
+  {
+    s_solve_stage = SOLVE_WLD;
+  }
+  eval_set_phase(pos->empties - EVAL_LOOKAHEAD_EMPTIES);
+  reset_move_ordering();
+#if defined(REVERSI_HOST)
+  s_shared_stop = NULL;
+#endif
+#if AI_STATS
+  memset(&s_stats, 0, sizeof(s_stats));
+#endif
+}
+
+//Starts an iterative deepening search from pos that should finish within budget_ms, at a ProbCut selectivity level.
+void ai_start_search(const Position *pos, int budget_ms, int selectivity)
+{
+  prepare_search(pos, budget_ms, selectivity);
+  tt_new_search();
+}
+
+#if defined(REVERSI_HOST)
+//Starts a helper for a search another thread started on the same position, sharing its transposition table.
+//It has no deadline, and stops once *stop is set or it reaches depth_limit.  The depth limit and features are per
+//thread, so the helper takes the other thread's as arguments.  Helpers that go deeper by more than a ply at a time are
+//out of step with the rest, so they fill the table with other depths' results.
+void ai_start_helper_search(const Position *pos, int selectivity, int depth_step, int depth_limit, int features,
+                            const bool *stop)
+{
+  s_depth_limit = depth_limit;
+  s_features = features;
+  prepare_search(pos, 0, selectivity);
+  s_depth_step = depth_step;
+  s_shared_stop = stop;
+}
+#endif
+
+static int get_next_depth()
+{
+  return min(s_search_depth + s_depth_step, s_search_max_depth);
+}
+
+//Starts the next iteration: deeper, or the next stage of an endgame solve.
+static void start_next_iteration()
+{
+  if(s_solve_stage != SOLVE_OFF && s_search_depth > 0 && !s_solving)
+  {
+    uint32_t elapsed = get_time_ms() - s_search_start_ms;
+    s_solving = (s_budget_ms == 0 || s_search_depth >= s_search_max_depth || elapsed * ENDGAME_FALLBACK_SHARE >= s_budget_ms);
+  }
+  if(!s_solving)
   {
-    return_score = -10000;
+    s_iteration_depth = get_next_depth();
+    start_iteration(s_iteration_depth, s_window_alpha, s_window_beta);
+  }
+  else if(s_solve_stage == SOLVE_WLD)
+  {
+    start_iteration(s_search_pos.empties, -1, 1);
   }
   else
   {
-    return_score = 10000;
+    //Test just past whichever bound the last pass moved.
+    int beta = (s_root_score == s_solve_lower) ? s_root_score + 1 : s_root_score;
+    start_iteration(s_search_pos.empties, beta - 1, beta);
   }
-  int return_index = 0;
-  int cur_selection_index = 0;
-  for(int i = 0; i < BOARD_WIDTH; i++)
+}
+
+//Takes in a finished heuristic iteration.  One whose score fell outside its aspiration window is searched
+//again at the same depth with the window widened on that side.
+static void finish_iteration()
+{
+  if(s_root_score <= s_window_alpha && s_window_alpha > ALPHA_MIN)
   {
-    for(int j = 0; j < BOARD_HEIGHT; j++)
+    s_window_alpha = max(s_root_score - s_window_delta, ALPHA_MIN);
+    s_window_delta *= 2;
+    return;
+  }
+  if(s_root_score >= s_window_beta && s_window_beta < BETA_MAX)
+  {
+    //The move that failed high is better than anything the last iteration found, so it's worth playing if time runs out.
+    s_search_best_move = s_frames[0].best_index;
+    s_window_beta = min(s_root_score + s_window_delta, BETA_MAX);
+    s_window_delta *= 2;
+    return;
+  }
+  s_search_depth = s_iteration_depth;
+  s_search_score = s_root_score;
+  s_search_best_move = s_frames[0].best_index;
+  s_iteration_scores[s_search_depth & 1] = s_root_score;
+  s_iteration_parities |= 1 << (s_search_depth & 1);
+  int next_depth = get_next_depth();
+  if((s_features & AI_FEATURE_ASPIRATION) && (s_iteration_parities & (1 << (next_depth & 1))))
+  {
+    int centre = s_iteration_scores[next_depth & 1];
+    s_window_delta = ASPIRATION_WINDOW;
+    s_window_alpha = max(centre - s_window_delta, ALPHA_MIN);
+    s_window_beta = min(centre + s_window_delta, BETA_MAX);
+  }
+}
+
+//Called once the search is done.  Returns true, for ai_continue_search to pass on.
+static bool finish_search()
+{
+#if AI_STATS
+  s_stats.nodes = s_search_nodes;
+  s_stats.elapsed_ms = get_time_ms() - s_search_start_ms;
+  s_stats.depth = s_search_depth;
+  s_stats.max_ply = s_frame_high_water;
+#if defined(REVERSI_HOST)
+  //Only the search that picks the move reports, not its helpers.
+  if(s_shared_stop == NULL)
+#endif
+  {
+    stats_log(&s_stats);
+  }
+#endif
+  return true;
+}
+
+//Searches for one time slice.  Returns true once the search is done and ai_get_best_move() is final.
+bool ai_continue_search()
+{
+  s_slicing = true;
+  s_slice_start_ms = get_time_ms();
+  s_slice_start_nodes = s_search_nodes;
+  while(true)
+  {
+    if(s_frame_top < 0)
     {
-      if(board[get_board_index(i,j)] == SELECTABLE)
+      if(s_search_depth > 0)
       {
-        char new_board[8*8];
-        memcpy(new_board, board, sizeof(char[BOARD_WIDTH*BOARD_HEIGHT]));
-        commit_selection(new_board, i, j, current_player);
-
-        if(cur_depth == 0)
+        uint32_t elapsed = get_time_ms() - s_search_start_ms;
+        bool finished = (s_solve_stage == SOLVE_OFF) ? (s_search_depth >= s_search_max_depth) : (s_solve_stage == SOLVE_DONE);
+        //The next iteration would take at least as long as all the previous ones together.
+        //Solve passes get the whole budget instead; one cut short still leaves the last pass's move.
+        if(s_stop_requested || finished || (s_budget_ms > 0 && elapsed * 2 >= s_budget_ms && !s_solving))
         {
-          //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d Checking branch with alpha: %d and beta: %d at depth %d", current_player, alpha, beta, cur_depth);
-
-          // if cur depth = 0, evaluate all available board positions via the board_evaluator
-            // if black, return highest value.
-            // if white, return lowest value.
-          int new_score = board_evaluator(new_board);
-          
-          if(get_player_char(current_player) == BLACK)
-          {
-            if(new_score > return_score)
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);
-            }
-            if(new_score == return_score && RANDOMIZE_EQUIVALENT_MOVES && flip_coin())
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);              
-            }
-            #if ALPHA_BETA
-            if(beta <= return_score)
-            {
-              //Prune: best case this tree is as bad as options we've already discovered.
-              //  This will be used to actually play the move.
-               *selection_index = return_index;
-              //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d Pruning branch with score: %d and beta: %d at depth %d", current_player, return_score, beta, cur_depth);
-              return return_score;
-            }
-            #endif
-          }
-          else
-          {
-            if(new_score < return_score)
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);
-            }
-            if(new_score == return_score && RANDOMIZE_EQUIVALENT_MOVES && flip_coin())
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);              
-            }
-            #if ALPHA_BETA
-            if(return_score <= alpha)
-            {
-              //Prune: best case this tree is as bad as options we've already discovered.
-              //  This will be used to actually play the move.
-               *selection_index = return_index;
-              //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d Pruning branch with score: %d and alpha: %d at depth %d", current_player, return_score, alpha, cur_depth);
-               return return_score;
-            }
-            #endif
-          }
+          return finish_search();
         }
-        else
-        {
-
-          // else, recursively call min_max evaluator on all board positions, with cur_depth lowered, and current_player toggled
-            // if black, return highest value.
-            // if white, return lowest value.
-          if(get_player_char(current_player) == BLACK)
-          {
-            //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d is about to call min_max.", current_player);
-            int new_score = min_max_evaluator(new_board, cur_depth-1, toggle_player(current_player), return_score, beta, selection_index);            
-            //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d called min_max and got back:%d", current_player, new_score);
-            if(new_score > return_score)
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);
-            }
-            if(new_score == return_score && RANDOMIZE_EQUIVALENT_MOVES && flip_coin())
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);              
-            }
-            if(beta <= return_score)
-            {
-              //Prune: best case this tree is as bad as options we've already discovered.
-              //  This will be used to actually play the move.
-              // *selection_index = return_index;
-              //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d Pruning branch with score: %d and beta: %d at depth %d", current_player, return_score, beta, cur_depth);
-              //return return_score;
-            }
-          }
-          else
-          {
-            //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d is about to call min_max.", current_player);
-            int new_score = min_max_evaluator(new_board, cur_depth-1, toggle_player(current_player), alpha, return_score, selection_index);      
-            //APP_LOG(APP_LOG_LEVEL_INFO, "Player %d called min_max and got back:%d", current_player, new_score);
-            if(new_score < return_score)
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);
-            }
-            if(new_score == return_score && RANDOMIZE_EQUIVALENT_MOVES && flip_coin())
-            {
-              return_score = new_score;
-              return_index = get_board_index(i,j);              
-            }
-            if(return_score <= alpha)
-            {
-              //Prune: best case this tree is as bad as options we've already discovered.
-              //  This will be used to actually play the move.
-              // *selection_index = return_index;
-              //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d Pruning branch with score: %d and alpha: %d at depth %d", current_player, return_score, alpha, cur_depth);
-              //return return_score;
-            }
-          }
-        }
-        cur_selection_index++;
       }
+      start_next_iteration();
+    }
+    int result = run_search();
+    if(result == SEARCH_SUSPENDED)
+    {
+      return false;
+    }
+    if(result == SEARCH_ABORTED)
+    {
+      return finish_search();
     }
+    if(!s_solving)
+    {
+      finish_iteration();
+    }
+    else
+    {
+      //Fail-soft null windows: a fail high raises the lower bound, and its move is at least that good.
+      //A fail low only lowers the upper bound, and says nothing about which move is best.
+      if(s_root_score > s_frames[0].alpha)
+      {
+        s_solve_lower = s_root_score;
+        s_search_best_move = s_frames[0].best_index;
+      }
+      if(s_root_score < s_frames[0].beta)
+      {
+        s_solve_upper = s_root_score;
+      }
+      s_solve_stage = (s_solve_lower >= s_solve_upper) ? SOLVE_DONE : SOLVE_EXACT;
+    }
+  }
+}
+
+//Ask the search to stop as soon as it can and play the best move found so far.
+void ai_stop_search()
+{
+  s_stop_requested = true;
+}
+
+int ai_get_best_move()
+{
+  return s_search_best_move;
+}
+
+//Score of the last completed heuristic iteration for the side to move, and its depth.
+int ai_get_search_score()
+{
+  return s_search_score;
+}
+
+int ai_get_search_depth()
+{
+  return s_search_depth;
+}
+
+uint32_t ai_get_search_nodes()
+{
+  return s_search_nodes;
+}
+
+#if defined(REVERSI_HOST)
+//Forgets everything earlier searches learnt, so the next search depends on its position alone.
+void ai_clear()
+{
+  tt_clear();
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+  {
+    s_history[i] = 0;
   }
-  //FOR ALL RETURNS: set the selection index to the index of the move corresponding to the returned option.
-  //  This will be used to actually play the move.
-  *selection_index = return_index;
-  //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d Returning score: %d and index: %d", current_player, return_score, return_index);
-  return return_score;
+}
+
+//Turns search features on and off, to measure what each is worth.
+void ai_set_features(int features)
+{
+  s_features = features;
+}
+
+int ai_get_features()
+{
+  return s_features;
+}
+
+//Caps how deep iterative deepening goes, for fixed-depth searches, which never turn into an endgame solve.  0 lifts the cap.
+void ai_set_depth_limit(int depth)
+{
+  s_depth_limit = depth;
+}
+#endif
+
+#if AI_STATS
+//Statistics of the last search, complete once it's done.
+const SearchStats *ai_get_search_stats()
+{
+  return &s_stats;
+}
+#endif
+
+//Deepest frame the last search used, and how many the arena has.
+int ai_get_stack_high_water()
+{
+  return s_frame_high_water;
+}
+
+int ai_get_stack_capacity()
+{
+  return SEARCH_FRAMES;
 }
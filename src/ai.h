@@ -1,6 +1,32 @@
 #ifndef AI_H
 #define AI_H
 
+//Search features.  The watch always uses them all; host tools can switch them off for comparison.
+#define AI_FEATURE_PVS 1 //Principal variation search: null windows for all but the first move.
+#define AI_FEATURE_ASPIRATION 2 //Root windows around the previous iteration's score.
+#define AI_FEATURES_ALL (AI_FEATURE_PVS | AI_FEATURE_ASPIRATION)
+
 int min_max_evaluator(char* board, int cur_depth, int current_player, int alpha, int beta, int *selection_index);
 
+//Time-budgeted iterative deepening.
+int get_move_budget_ms(int strength, int empties);
+int get_move_selectivity(int strength);
+void ai_start_search(const Position *pos, int budget_ms, int selectivity);
+bool ai_continue_search();
+void ai_stop_search();
+int ai_get_best_move();
+int ai_get_search_score();
+int ai_get_search_depth();
+uint32_t ai_get_search_nodes();
+int ai_get_stack_high_water();
+int ai_get_stack_capacity();
+#if defined(REVERSI_HOST)
+void ai_start_helper_search(const Position *pos, int selectivity, int depth_step, int depth_limit, int features,
+                            const bool *stop);
+void ai_clear();
+void ai_set_features(int features);
+int ai_get_features();
+void ai_set_depth_limit(int depth);
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "platform.h"
+#include "util.h"
+#include "game.h"
+#include "ai.h"
+#include "ai_worker.h"
+
+//On the host the worker is a stand-in in the same process, so tools can put searches through the protocol.
+//A message is a call to the other side's handler, and the worker runs a slice of its search each time the app asks
+//whether it's done.  On the watch the app and the worker each build their own side, and messages go through the SDK.
+
+#define AI_WORKER_SLICE_DELAY 1 //The worker has no display to keep up, only messages to let in.
+#define AI_WORKER_GRACE_MS 2000 //How long past its budget the app waits for the worker before searching itself.
+
+#if defined(REVERSI_HOST)
+static void handle_reply(uint16_t type, AppWorkerMessage *data);
+#endif
+
+//Worker side
+
+#if defined(REVERSI_WORKER) || defined(REVERSI_HOST)
+static uint64_t s_request_discs[2];
+static int s_serving_id = -1; //The search in progress, -1 for none.
+#if !defined(REVERSI_HOST)
+static AppTimer *s_slice_timer;
+#endif
+
+static void send_to_app(uint8_t type, AppWorkerMessage *message)
+{
+#if defined(REVERSI_HOST)
+  handle_reply(type, message);
+#else
+  app_worker_send_message(type, message);
+#endif
+}
+
+static void serve_slice(void *data);
+
+static void schedule_slice()
+{
+#if !defined(REVERSI_HOST)
+  if(s_slice_timer == NULL)
+  {
+    s_slice_timer = app_timer_register(AI_WORKER_SLICE_DELAY, serve_slice, NULL);
+  }
+#endif
+}
+
+//One slice of the worker's search.  Sends the move once it's done.
+static void serve_slice(void *data)
+{
+  (void)data;
+#if !defined(REVERSI_HOST)
+  s_slice_timer = NULL;
+#endif
+  if(s_serving_id < 0)
+  {
+    return;
+  }
+  if(!ai_continue_search())
+  {
+    schedule_slice();
+    return;
+  }
+  AppWorkerMessage reply = {
+    .data0 = s_serving_id,
+    .data1 = (uint16_t)ai_get_best_move(),
+    .data2 = ai_get_search_depth(),
+  };
+  s_serving_id = -1;
+  send_to_app(AI_WORKER_MSG_MOVE, &reply);
+}
+
+static void handle_request(uint16_t type, AppWorkerMessage *data)
+{
+  if(type == AI_WORKER_MSG_DISCS)
+  {
+    int shift = (data->data0 & 1) * 32;
+    uint64_t *discs = &s_request_discs[(data->data0 >> 1) & 1];
+    uint64_t half = ((uint64_t)data->data2 << 16) | data->data1;
+    *discs = (*discs & ~(0xFFFFFFFFULL << shift)) | (half << shift);
+  }
+  else if(type == AI_WORKER_MSG_SEARCH)
+  {
+    Position pos;
+    bitboards_to_position(s_request_discs[0], s_request_discs[1], data->data0 & 1, &pos);
+    s_serving_id = data->data0 >> 1;
+    ai_start_search(&pos, data->data1, data->data2);
+    schedule_slice();
+  }
+  else if(type == AI_WORKER_MSG_STOP && data->data0 == s_serving_id)
+  {
+    ai_stop_search();
+  }
+}
+#endif
+
+#if defined(REVERSI_WORKER)
+void ai_worker_serve()
+{
+  app_worker_message_subscribe(handle_request);
+}
+#endif
+
+//App side
+
+#if !defined(REVERSI_WORKER)
+static int s_search_id;
+static bool s_remote; //The current search is the worker's.
+static bool s_replied;
+static int s_best_move; //The worker's, once it has replied.
+static Position s_search_pos; //To check the worker's move against, and to search here if it never comes.
+static int s_budget_ms;
+static int s_selectivity;
+static uint32_t s_start_ms;
+#if defined(REVERSI_HOST)
+static bool s_host_worker_running;
+#endif
+
+static void send_to_worker(uint8_t type, AppWorkerMessage *message)
+{
+#if defined(REVERSI_HOST)
+  handle_request(type, message);
+#else
+  app_worker_send_message(type, message);
+#endif
+}
+
+#if AI_WORKER || defined(REVERSI_HOST)
+static void handle_reply(uint16_t type, AppWorkerMessage *data)
+{
+  if(type == AI_WORKER_MSG_MOVE && s_remote && data->data0 == s_search_id)
+  {
+    s_replied = true;
+    s_best_move = (int16_t)data->data1;
+  }
+}
+#endif
+
+static bool is_worker_running()
+{
+#if defined(REVERSI_HOST)
+  return s_host_worker_running;
+#elif AI_WORKER
+  return app_worker_is_running();
+#else
+  return false;
+#endif
+}
+
+static void search_here()
+{
+  s_remote = false;
+  ai_start_search(&s_search_pos, s_budget_ms, s_selectivity);
+}
+
+//Starts the worker.  It takes a moment, and searches run in the app until it's up.
+void ai_worker_init()
+{
+#if defined(REVERSI_HOST)
+  s_host_worker_running = true;
+#elif AI_WORKER
+  app_worker_message_subscribe(handle_reply);
+  app_worker_launch();
+#endif
+}
+
+//A worker left running would keep the slot that every app shares, so it goes when the app does.
+void ai_worker_deinit()
+{
+#if defined(REVERSI_HOST)
+  s_host_worker_running = false;
+#elif AI_WORKER
+  app_worker_message_unsubscribe();
+  app_worker_kill();
+#endif
+}
+
+void ai_worker_start_search(const Position *pos, int budget_ms, int selectivity)
+{
+  s_search_pos = *pos;
+  s_budget_ms = budget_ms;
+  s_selectivity = selectivity;
+  s_start_ms = get_time_ms();
+  s_search_id = (s_search_id + 1) % AI_WORKER_SEARCH_IDS;
+  s_replied = false;
+  if(!is_worker_running())
+  {
+    search_here();
+    return;
+  }
+  s_remote = true;
+  for(int i = 0; i < 4; i++)
+  {
+    uint32_t half = (uint32_t)(pos->discs[i >> 1] >> ((i & 1) * 32));
+    AppWorkerMessage discs = { .data0 = i, .data1 = half & 0xFFFF, .data2 = half >> 16 };
+    send_to_worker(AI_WORKER_MSG_DISCS, &discs);
+  }
+  AppWorkerMessage search = { .data0 = (s_search_id << 1) | pos->player, .data1 = budget_ms, .data2 = selectivity };
+  send_to_worker(AI_WORKER_MSG_SEARCH, &search);
+}
+
+//True once there's a move to play.  A worker that sends back a move that isn't legal, or never answers at all, has lost
+//a message somewhere, and the search starts over in the app.
+bool ai_worker_continue_search()
+{
+  if(!s_remote)
+  {
+    return ai_continue_search();
+  }
+#if defined(REVERSI_HOST)
+  serve_slice(NULL);
+#endif
+  if(s_replied)
+  {
+    uint64_t moves = 0;
+    if(s_best_move >= 0 && get_move_status(&s_search_pos, &moves) == MOVES_AVAILABLE && ((moves >> s_best_move) & 1))
+    {
+      return true;
+    }
+    search_here();
+  }
+#if !defined(REVERSI_HOST)
+  else if(get_time_ms() - s_start_ms > (uint32_t)s_budget_ms + AI_WORKER_GRACE_MS)
+  {
+    search_here();
+  }
+#endif
+  return false;
+}
+
+void ai_worker_stop_search()
+{
+  if(!s_remote)
+  {
+    ai_stop_search();
+    return;
+  }
+  AppWorkerMessage stop = { .data0 = s_search_id };
+  send_to_worker(AI_WORKER_MSG_STOP, &stop);
+}
+
+int ai_worker_get_best_move()
+{
+  return s_remote ? s_best_move : ai_get_best_move();
+}
+#endif
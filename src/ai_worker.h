@@ -0,0 +1,31 @@
+#ifndef AI_WORKER_H
+#define AI_WORKER_H
+
+//The app's searches, wherever they run.  With AI_WORKER 1 (see util.h) they run in the background worker whenever it
+//is running, so the search can never hold up a redraw or a button press.  Otherwise they run in the app, a slice at a
+//time, as ai.c's searches always did.  The calls are the same either way.
+
+//Worker messages.  An AppWorkerMessage is three uint16s, so a position goes over as four DISCS messages and a SEARCH.
+#define AI_WORKER_MSG_DISCS 0 //App to worker.  data0: which 32 bits (black low, black high, white low, white high),
+                              //data1 and data2: their low and high 16.
+#define AI_WORKER_MSG_SEARCH 1 //App to worker: search the discs sent.  data0: search id << 1 | side to move,
+                               //data1: budget in ms, data2: selectivity.  Drops any search the worker was running.
+#define AI_WORKER_MSG_STOP 2 //App to worker: move now.  data0: search id.
+#define AI_WORKER_MSG_MOVE 3 //Worker to app: the search is done.  data0: search id, data1: move, data2: depth.
+
+#define AI_WORKER_SEARCH_IDS 0x8000 //Search ids count up and wrap here, so an id and the side to move fit in a uint16.
+
+//App side
+void ai_worker_init();
+void ai_worker_deinit();
+void ai_worker_start_search(const Position *pos, int budget_ms, int selectivity);
+bool ai_worker_continue_search();
+void ai_worker_stop_search();
+int ai_worker_get_best_move();
+
+//Worker side: answers the app's messages until the worker exits.
+#if defined(REVERSI_WORKER)
+void ai_worker_serve();
+#endif
+
+#endif
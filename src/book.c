@@ -0,0 +1,183 @@
+#include "platform.h"
+#include <stdlib.h>
+#include "util.h"
+#include "game.h"
+#include "book.h"
+
+// The book is read a few bytes at a time straight from the resource, so it never has to fit in RAM.
+// Host builds have no resources, so tools hand the book over as a buffer instead.
+#if defined(REVERSI_HOST)
+static const uint8_t *s_book_data;
+#else
+static ResHandle s_book_handle;
+#endif
+static size_t s_book_size;
+static int s_book_count;
+
+static bool read_book(uint32_t offset, uint8_t *buffer, size_t length)
+{
+  if(offset + length > s_book_size)
+  {
+    return false;
+  }
+#if defined(REVERSI_HOST)
+  memcpy(buffer, s_book_data + offset, length);
+  return true;
+#else
+  return resource_load_byte_range(s_book_handle, offset, buffer, length) == length;
+#endif
+}
+
+// Checks the header and takes the entry count from it.  A bad or missing book is simply empty.
+static void read_header()
+{
+  uint8_t header[BOOK_HEADER_SIZE];
+  s_book_count = 0;
+  if(!read_book(0, header, BOOK_HEADER_SIZE) || header[0] != 'R' || header[1] != 'B' || header[2] != 'K' || header[3] != BOOK_VERSION)
+  {
+    return;
+  }
+  int count = header[4] | (header[5] << 8);
+  s_book_count = min(count, (int)((s_book_size - BOOK_HEADER_SIZE) / BOOK_ENTRY_SIZE));
+}
+
+void book_init()
+{
+#if defined(REVERSI_HOST)
+  s_book_data = NULL;
+  s_book_size = 0;
+  s_book_count = 0;
+#else
+  s_book_handle = resource_get_handle(RESOURCE_ID_OPENING_BOOK);
+  s_book_size = resource_size(s_book_handle);
+  read_header();
+#endif
+}
+
+#if defined(REVERSI_HOST)
+void book_set_data(const uint8_t *data, size_t size)
+{
+  s_book_data = data;
+  s_book_size = size;
+  read_header();
+}
+#endif
+
+static void read_entry(int i, uint32_t *key, int *move, int *weight)
+{
+  uint8_t bytes[BOOK_ENTRY_SIZE];
+  if(!read_book(BOOK_HEADER_SIZE + i * BOOK_ENTRY_SIZE, bytes, BOOK_ENTRY_SIZE))
+  {
+    memset(bytes, 0, BOOK_ENTRY_SIZE);
+  }
+  *key = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  *move = bytes[4];
+  *weight = bytes[5];
+}
+
+static uint64_t transform_bits(uint64_t bits, int symmetry)
+{
+  switch(symmetry)
+  {
+    case 1:
+      return bitboard_flip_diagonal(bits);
+    case 2:
+      return bitboard_flip_anti_diagonal(bits);
+    case 3:
+      return bitboard_flip_anti_diagonal(bitboard_flip_diagonal(bits)); //The half turn.
+  }
+  return bits;
+}
+
+int book_transform_index(int index, int symmetry)
+{
+  return __builtin_ctzll(transform_bits(1ULL << index, symmetry));
+}
+
+// Returns the smallest hash over the position's symmetric twins, and which symmetry produced it.
+// Transposed and mirrored move orders all land on the same book entry this way.
+uint64_t book_get_canonical_hash(const Position *pos, int *symmetry)
+{
+  Position twin = *pos;
+  uint64_t best = 0;
+  for(int s = 0; s < BOOK_SYMMETRIES; s++)
+  {
+    twin.discs[0] = transform_bits(pos->discs[0], s);
+    twin.discs[1] = transform_bits(pos->discs[1], s);
+    uint64_t hash = compute_position_hash(&twin);
+    if(s == 0 || hash < best)
+    {
+      best = hash;
+      *symmetry = s;
+    }
+  }
+  return best;
+}
+
+uint32_t book_get_key(uint64_t canonical_hash)
+{
+  return (uint32_t)(canonical_hash >> 32);
+}
+
+// Looks the position up in the book.  Returns true with a legal move in *index if it's there.
+bool book_get_move(const Position *pos, int *index)
+{
+  if(s_book_count == 0)
+  {
+    return false;
+  }
+  int symmetry = 0;
+  uint32_t key = book_get_key(book_get_canonical_hash(pos, &symmetry));
+  uint32_t entry_key = 0;
+  int move = 0;
+  int weight = 0;
+  // Binary search for the first entry with this key.
+  int low = 0;
+  int high = s_book_count;
+  while(low < high)
+  {
+    int mid = (low + high) / 2;
+    read_entry(mid, &entry_key, &move, &weight);
+    if(entry_key < key)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  // Pick one of its moves at random, in proportion to weight.  Checking legality means
+  // a key collision with some other position can't make the AI play an illegal move.
+  uint64_t legal = bitboard_get_moves(pos->discs[pos->player], pos->discs[toggle_player(pos->player)]);
+  int total = 0;
+  int chosen = -1;
+  for(int i = low; i < s_book_count; i++)
+  {
+    read_entry(i, &entry_key, &move, &weight);
+    if(entry_key != key)
+    {
+      break;
+    }
+    if(weight == 0 || move >= BOARD_WIDTH*BOARD_HEIGHT)
+    {
+      continue;
+    }
+    move = book_transform_index(move, symmetry);
+    if(!(legal & (1ULL << move)))
+    {
+      continue;
+    }
+    total += weight;
+    if(rand() % total < weight)
+    {
+      chosen = move;
+    }
+  }
+  if(chosen < 0)
+  {
+    return false;
+  }
+  *index = chosen;
+  return true;
+}
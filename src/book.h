@@ -0,0 +1,26 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+//Opening book resource layout.  Everything is little endian.
+//  header: 'R' 'B' 'K' BOOK_VERSION, then a uint16 entry count
+//  entries, sorted by key: uint32 key, uint8 move, uint8 weight
+//The key is the top half of the position's canonical hash, and the move is in canonical orientation.
+//A position can have several entries; one is picked at random in proportion to weight.
+#define BOOK_VERSION 1
+#define BOOK_HEADER_SIZE 6
+#define BOOK_ENTRY_SIZE 6
+
+//The four symmetries of the starting position: identity, the two diagonal flips and the half turn.
+//Each one is its own inverse.
+#define BOOK_SYMMETRIES 4
+
+void book_init();
+#if defined(REVERSI_HOST)
+void book_set_data(const uint8_t *data, size_t size);
+#endif
+bool book_get_move(const Position *pos, int *index);
+uint64_t book_get_canonical_hash(const Position *pos, int *symmetry);
+uint32_t book_get_key(uint64_t canonical_hash);
+int book_transform_index(int index, int symmetry);
+
+#endif
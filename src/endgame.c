@@ -0,0 +1,373 @@
+#include "platform.h"
+#include <stdlib.h>
+#include "util.h"
+#include "game.h"
+#include "endgame.h"
+
+#define NO_SCORE (-ENDGAME_MAX_SCORE - 1) //Worse than any real score, so the first move always replaces it.
+
+// Move ordering in the shallow solver.  From this many empties up, counting the opponent's replies
+// to each move (fastest first) pays for itself; below it parity alone is cheaper.
+#define FASTEST_FIRST_EMPTIES 6
+#define PARITY_BONUS 8
+
+// Quadrants of the board.  A region with an odd number of empty squares is one where the side to move
+// can expect to play last, so those moves are tried first (parity ordering).
+static const uint64_t QUADRANT_MASKS[4] = {0x000000000f0f0f0fULL, 0x00000000f0f0f0f0ULL, 0x0f0f0f0f00000000ULL, 0xf0f0f0f000000000ULL};
+
+// Lines for the stability test.  A disc on a completely filled line can't be flipped along it.
+#define BB_RANK_1 0x00000000000000ffULL
+#define BB_EDGE_RANKS 0xff000000000000ffULL
+#define BB_EDGE_FILES 0x8181818181818181ULL
+#define BB_BORDER 0xff818181818181ffULL
+static const uint64_t DIAGONAL_MASKS[15] = {
+  0x0100000000000000ULL, 0x0201000000000000ULL, 0x0402010000000000ULL, 0x0804020100000000ULL, 0x1008040201000000ULL,
+  0x2010080402010000ULL, 0x4020100804020100ULL, 0x8040201008040201ULL, 0x0080402010080402ULL, 0x0000804020100804ULL,
+  0x0000008040201008ULL, 0x0000000080402010ULL, 0x0000000000804020ULL, 0x0000000000008040ULL, 0x0000000000000080ULL
+};
+static const uint64_t ANTI_DIAGONAL_MASKS[15] = {
+  0x0000000000000001ULL, 0x0000000000000102ULL, 0x0000000000010204ULL, 0x0000000001020408ULL, 0x0000000102040810ULL,
+  0x0000010204081020ULL, 0x0001020408102040ULL, 0x0102040810204080ULL, 0x0204081020408000ULL, 0x0408102040800000ULL,
+  0x0810204080000000ULL, 0x1020408000000000ULL, 0x2040800000000000ULL, 0x4080000000000000ULL, 0x8000000000000000ULL
+};
+
+// Returns the discs of "own" that can never be flipped.  A disc is stable if, along each of the four lines
+// through it, the line is full or one of its neighbours is the board edge or another stable disc of the same color.
+// The shifts below can wrap around a row, but only ever onto border squares, which pass that test anyway.
+static uint64_t get_stable_discs(uint64_t own, uint64_t opp)
+{
+  uint64_t occupied = own | opp;
+  uint64_t full_h = 0;
+  for(int y = 0; y < BOARD_HEIGHT; y++)
+  {
+    if(((occupied >> (y * BOARD_WIDTH)) & BB_RANK_1) == BB_RANK_1)
+    {
+      full_h |= BB_RANK_1 << (y * BOARD_WIDTH);
+    }
+  }
+  uint64_t columns = occupied & (occupied >> 32);
+  columns &= columns >> 16;
+  columns &= columns >> 8;
+  uint64_t full_v = (columns & BB_RANK_1) * 0x0101010101010101ULL;
+  uint64_t full_d1 = 0;
+  uint64_t full_d2 = 0;
+  for(int i = 0; i < 15; i++)
+  {
+    if((occupied & DIAGONAL_MASKS[i]) == DIAGONAL_MASKS[i])
+    {
+      full_d1 |= DIAGONAL_MASKS[i];
+    }
+    if((occupied & ANTI_DIAGONAL_MASKS[i]) == ANTI_DIAGONAL_MASKS[i])
+    {
+      full_d2 |= ANTI_DIAGONAL_MASKS[i];
+    }
+  }
+  uint64_t stable = 0;
+  uint64_t last = 0;
+  do
+  {
+    last = stable;
+    uint64_t safe_h = full_h | BB_EDGE_FILES | (stable << 1) | (stable >> 1);
+    uint64_t safe_v = full_v | BB_EDGE_RANKS | (stable << 8) | (stable >> 8);
+    uint64_t safe_d1 = full_d1 | BB_BORDER | (stable << 9) | (stable >> 9);
+    uint64_t safe_d2 = full_d2 | BB_BORDER | (stable << 7) | (stable >> 7);
+    stable |= own & safe_h & safe_v & safe_d1 & safe_d2;
+  } while(stable != last);
+  return stable;
+}
+
+// Every stable opponent disc is one the side to move can never own, so its score is at most 64 - 2 * stable.
+// Returns true, with that bound in *value, if the bound already fails low.
+static bool stability_cutoff(uint64_t own, uint64_t opp, int alpha, int *value)
+{
+  // Not even a fully stable opponent could push the bound down to alpha, so skip the work.
+  if(alpha < ENDGAME_MAX_SCORE - 2 * bitboard_count(opp))
+  {
+    return false;
+  }
+  int bound = ENDGAME_MAX_SCORE - 2 * bitboard_count(get_stable_discs(opp, own));
+  if(bound <= alpha)
+  {
+    *value = bound;
+    return true;
+  }
+  return false;
+}
+
+// Returns the squares of every quadrant holding an odd number of empty squares.
+uint64_t endgame_get_odd_regions(uint64_t empty)
+{
+  uint64_t odd = 0;
+  for(int q = 0; q < 4; q++)
+  {
+    if(bitboard_count(empty & QUADRANT_MASKS[q]) & 1)
+    {
+      odd |= QUADRANT_MASKS[q];
+    }
+  }
+  return odd;
+}
+
+// Final disc differential for the side to move.  Empty squares left at the end don't count for either side.
+int endgame_final_score(const Position *pos)
+{
+  return pos->disc_count[pos->player] - pos->disc_count[toggle_player(pos->player)];
+}
+
+bool endgame_stability_cutoff(const Position *pos, int alpha, int *value)
+{
+  return stability_cutoff(pos->discs[pos->player], pos->discs[toggle_player(pos->player)], alpha, value);
+}
+
+// Hand-written solvers for the last four empty squares.  They work straight on the two bitboards,
+// with the empty squares passed in, so there's no move generation, hashing or undo record down here.
+// passed is set when the opponent has just had to pass, so a second pass ends the game.
+static int solve_1(uint64_t own, uint64_t opp, int x1)
+{
+  // Every other square is full, so own - opp is 2 * own - 63.
+  int score = 2 * bitboard_count(own) - 63;
+  uint64_t flips = bitboard_get_flips(own, opp, x1);
+  if(flips != 0)
+  {
+    return score + 2 * bitboard_count(flips) + 1;
+  }
+  flips = bitboard_get_flips(opp, own, x1);
+  if(flips != 0)
+  {
+    return score - 2 * bitboard_count(flips) - 1;
+  }
+  return score;
+}
+
+static int solve_2(uint64_t own, uint64_t opp, int alpha, int beta, int x1, int x2, bool passed)
+{
+  int best = NO_SCORE;
+  uint64_t flips = bitboard_get_flips(own, opp, x1);
+  if(flips != 0)
+  {
+    best = -solve_1(opp ^ flips, own ^ flips ^ (1ULL << x1), x2);
+    if(best >= beta)
+    {
+      return best;
+    }
+  }
+  flips = bitboard_get_flips(own, opp, x2);
+  if(flips != 0)
+  {
+    best = max(best, -solve_1(opp ^ flips, own ^ flips ^ (1ULL << x2), x1));
+  }
+  if(best == NO_SCORE)
+  {
+    if(passed)
+    {
+      return bitboard_count(own) - bitboard_count(opp);
+    }
+    return -solve_2(opp, own, -beta, -alpha, x1, x2, true);
+  }
+  return best;
+}
+
+static int solve_3(uint64_t own, uint64_t opp, int alpha, int beta, int x1, int x2, int x3, bool passed)
+{
+  int best = NO_SCORE;
+  uint64_t flips = bitboard_get_flips(own, opp, x1);
+  if(flips != 0)
+  {
+    best = -solve_2(opp ^ flips, own ^ flips ^ (1ULL << x1), -beta, -alpha, x2, x3, false);
+    if(best >= beta)
+    {
+      return best;
+    }
+    alpha = max(alpha, best);
+  }
+  flips = bitboard_get_flips(own, opp, x2);
+  if(flips != 0)
+  {
+    int score = -solve_2(opp ^ flips, own ^ flips ^ (1ULL << x2), -beta, -alpha, x1, x3, false);
+    if(score > best)
+    {
+      best = score;
+      if(best >= beta)
+      {
+        return best;
+      }
+      alpha = max(alpha, best);
+    }
+  }
+  flips = bitboard_get_flips(own, opp, x3);
+  if(flips != 0)
+  {
+    best = max(best, -solve_2(opp ^ flips, own ^ flips ^ (1ULL << x3), -beta, -alpha, x1, x2, false));
+  }
+  if(best == NO_SCORE)
+  {
+    if(passed)
+    {
+      return bitboard_count(own) - bitboard_count(opp);
+    }
+    return -solve_3(opp, own, -beta, -alpha, x1, x2, x3, true);
+  }
+  return best;
+}
+
+static int solve_4(uint64_t own, uint64_t opp, int alpha, int beta, int x1, int x2, int x3, int x4, bool passed)
+{
+  int best = NO_SCORE;
+  uint64_t flips = bitboard_get_flips(own, opp, x1);
+  if(flips != 0)
+  {
+    best = -solve_3(opp ^ flips, own ^ flips ^ (1ULL << x1), -beta, -alpha, x2, x3, x4, false);
+    if(best >= beta)
+    {
+      return best;
+    }
+    alpha = max(alpha, best);
+  }
+  flips = bitboard_get_flips(own, opp, x2);
+  if(flips != 0)
+  {
+    int score = -solve_3(opp ^ flips, own ^ flips ^ (1ULL << x2), -beta, -alpha, x1, x3, x4, false);
+    if(score > best)
+    {
+      best = score;
+      if(best >= beta)
+      {
+        return best;
+      }
+      alpha = max(alpha, best);
+    }
+  }
+  flips = bitboard_get_flips(own, opp, x3);
+  if(flips != 0)
+  {
+    int score = -solve_3(opp ^ flips, own ^ flips ^ (1ULL << x3), -beta, -alpha, x1, x2, x4, false);
+    if(score > best)
+    {
+      best = score;
+      if(best >= beta)
+      {
+        return best;
+      }
+      alpha = max(alpha, best);
+    }
+  }
+  flips = bitboard_get_flips(own, opp, x4);
+  if(flips != 0)
+  {
+    best = max(best, -solve_3(opp ^ flips, own ^ flips ^ (1ULL << x4), -beta, -alpha, x1, x2, x3, false));
+  }
+  if(best == NO_SCORE)
+  {
+    if(passed)
+    {
+      return bitboard_count(own) - bitboard_count(opp);
+    }
+    return -solve_4(opp, own, -beta, -alpha, x1, x2, x3, x4, true);
+  }
+  return best;
+}
+
+// Hands the last few empty squares to the matching kernel, odd regions first.
+static int solve_last(uint64_t own, uint64_t opp, int alpha, int beta, uint64_t empty, bool passed)
+{
+  int squares[4];
+  int count = 0;
+  uint64_t odd = endgame_get_odd_regions(empty);
+  for(uint64_t bits = empty & odd; bits; bits &= bits - 1)
+  {
+    squares[count++] = __builtin_ctzll(bits);
+  }
+  for(uint64_t bits = empty & ~odd; bits; bits &= bits - 1)
+  {
+    squares[count++] = __builtin_ctzll(bits);
+  }
+  switch(count)
+  {
+    case 1:
+      return solve_1(own, opp, squares[0]);
+    case 2:
+      return solve_2(own, opp, alpha, beta, squares[0], squares[1], passed);
+    case 3:
+      return solve_3(own, opp, alpha, beta, squares[0], squares[1], squares[2], passed);
+    case 4:
+      return solve_4(own, opp, alpha, beta, squares[0], squares[1], squares[2], squares[3], passed);
+  }
+  return bitboard_count(own) - bitboard_count(opp);
+}
+
+// Fills move_list with the moves in the mask, best first.  Returns the move count.
+static int order_shallow_moves(uint64_t own, uint64_t opp, uint64_t moves, int empty_count, int8_t *move_list)
+{
+  int8_t keys[MAX_MOVES];
+  int count = 0;
+  uint64_t odd = endgame_get_odd_regions(~(own | opp));
+  for(; moves; moves &= moves - 1)
+  {
+    int index = __builtin_ctzll(moves);
+    int key = (odd & (1ULL << index)) ? PARITY_BONUS : 0;
+    if(empty_count >= FASTEST_FIRST_EMPTIES)
+    {
+      uint64_t flips = bitboard_get_flips(own, opp, index);
+      key -= 2 * PARITY_BONUS * bitboard_count(bitboard_get_moves(opp ^ flips, own ^ flips ^ (1ULL << index)));
+    }
+    //Insertion sort; there are only a handful of moves this late.
+    int i = count++;
+    for(; i > 0 && keys[i - 1] < key; i--)
+    {
+      keys[i] = keys[i - 1];
+      move_list[i] = move_list[i - 1];
+    }
+    keys[i] = key;
+    move_list[i] = index;
+  }
+  return count;
+}
+
+// Fail-soft alpha-beta down to the kernels, with parity and fastest first ordering and stability cutoffs.
+static int solve_shallow(uint64_t own, uint64_t opp, int alpha, int beta, int empty_count, bool passed)
+{
+  uint64_t empty = ~(own | opp);
+  if(empty_count <= 4)
+  {
+    return solve_last(own, opp, alpha, beta, empty, passed);
+  }
+  uint64_t moves = bitboard_get_moves(own, opp);
+  if(moves == 0)
+  {
+    if(passed)
+    {
+      return bitboard_count(own) - bitboard_count(opp);
+    }
+    return -solve_shallow(opp, own, -beta, -alpha, empty_count, true);
+  }
+  int best = NO_SCORE;
+  if(stability_cutoff(own, opp, alpha, &best))
+  {
+    return best;
+  }
+  int8_t move_list[MAX_MOVES];
+  int count = order_shallow_moves(own, opp, moves, empty_count, move_list);
+  for(int i = 0; i < count; i++)
+  {
+    int index = move_list[i];
+    uint64_t flips = bitboard_get_flips(own, opp, index);
+    int score = -solve_shallow(opp ^ flips, own ^ flips ^ (1ULL << index), -beta, -alpha, empty_count - 1, false);
+    if(score > best)
+    {
+      best = score;
+      if(best >= beta)
+      {
+        return best;
+      }
+      alpha = max(alpha, best);
+    }
+  }
+  return best;
+}
+
+// Exact score of a position with at most ENDGAME_SHALLOW_EMPTIES empty squares, for the side to move.
+// Fail-soft: a score outside (alpha, beta) is only a bound.
+int endgame_solve(const Position *pos, int alpha, int beta)
+{
+  return solve_shallow(pos->discs[pos->player], pos->discs[toggle_player(pos->player)], alpha, beta, pos->empties, false);
+}
@@ -0,0 +1,15 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+//Exact scores are final disc differentials for the side to move.
+#define ENDGAME_MAX_SCORE 64
+
+//With this few empty squares left the solver finishes with plain recursion instead of the AI's frame stack.
+#define ENDGAME_SHALLOW_EMPTIES 6
+
+int endgame_final_score(const Position *pos);
+bool endgame_stability_cutoff(const Position *pos, int alpha, int *value);
+uint64_t endgame_get_odd_regions(uint64_t empty);
+int endgame_solve(const Position *pos, int alpha, int beta);
+
+#endif
@@ -0,0 +1,202 @@
+#include "platform.h"
+#include <stdlib.h>
+#include "util.h"
+#include "game.h"
+#include "eval.h"
+
+//Where each pattern's table starts, and its squares in the a1 corner's image of the board.
+#define CORNER_2X3_TABLE 0 //a1 b1 c1 a2 b2 c2, at all eight images
+#define EDGE_6_TABLE 729 //a1 b1 c1 d1 e1 f1, at all eight images
+#define CORNER_DIAGONAL_TABLE 1458 //a1 b2 c3 d4, at one image per corner
+#define DIAGONAL_6_TABLE 1539 //c1 d2 e3 f4 g5 h6, likewise
+#define DIAGONAL_5_TABLE 2268 //d1 e2 f3 g4 h5
+#define DIAGONAL_4_TABLE 2511 //e1 f2 g3 h4
+//Then a table per count, indexed by the count itself.  Own first, then the opponent's.
+#define COUNT_TABLE_SIZE 65
+#define MOBILITY_TABLE 2592
+#define POTENTIAL_MOBILITY_TABLE 2722
+#define FRONTIER_TABLE 2852
+#define EDGE_STABLE_TABLE 2982
+
+//Each diagonal square is in its own column, so a multiply stacks them all into the top byte without carries.
+#define CORNER_DIAGONAL_MASK 0x0000000008040201ULL
+#define DIAGONAL_6_MASK 0x0000804020100804ULL
+#define DIAGONAL_5_MASK 0x0000008040201008ULL
+#define DIAGONAL_4_MASK 0x0000000080402010ULL
+#define COLUMN_GATHER 0x0101010101010101ULL
+
+//Only the current phase's tables are in RAM.  They're swapped in when a search starts in a new phase.
+//A background worker can't read resources, and has no room for the tables anyway, so it always counts.
+#if defined(REVERSI_HOST)
+static const uint8_t *s_eval_data;
+#elif !defined(REVERSI_WORKER)
+static ResHandle s_eval_handle;
+#endif
+static size_t s_eval_size;
+static bool s_eval_loaded;
+static int s_phase;
+#if defined(REVERSI_WORKER)
+static int16_t s_weights[1]; //Never read: with no tables loaded, s_phase stays -1.
+#else
+static int16_t s_weights[EVAL_TABLE_SIZE];
+#endif
+static uint16_t s_base3[64]; //Six bits read as base 3 digits: bit n is worth 3^n.
+
+static bool read_weights(uint32_t offset, void *buffer, size_t length)
+{
+  if(offset + length > s_eval_size)
+  {
+    return false;
+  }
+#if defined(REVERSI_HOST)
+  memcpy(buffer, s_eval_data + offset, length);
+  return true;
+#elif defined(REVERSI_WORKER)
+  return false;
+#else
+  return resource_load_byte_range(s_eval_handle, offset, buffer, length) == length;
+#endif
+}
+
+//A bad or missing weights resource leaves the tables unloaded, and eval_position falls back to counting.
+static void read_header()
+{
+  uint8_t header[EVAL_HEADER_SIZE];
+  s_eval_loaded = read_weights(0, header, EVAL_HEADER_SIZE) && header[0] == 'R' && header[1] == 'E' && header[2] == 'V' &&
+                  header[3] == EVAL_VERSION && header[4] == EVAL_PHASES &&
+                  s_eval_size >= EVAL_HEADER_SIZE + EVAL_PHASES * EVAL_TABLE_SIZE * sizeof(int16_t);
+  s_phase = -1;
+}
+
+void eval_init()
+{
+  for(int bits = 0; bits < 64; bits++)
+  {
+    s_base3[bits] = 0;
+    for(int n = 5; n >= 0; n--)
+    {
+      s_base3[bits] = s_base3[bits] * 3 + ((bits >> n) & 1);
+    }
+  }
+#if defined(REVERSI_HOST)
+  s_eval_data = NULL;
+  s_eval_size = 0;
+  s_eval_loaded = false;
+  s_phase = -1;
+#elif defined(REVERSI_WORKER)
+  s_eval_size = 0;
+  read_header();
+#else
+  s_eval_handle = resource_get_handle(RESOURCE_ID_EVAL_WEIGHTS);
+  s_eval_size = resource_size(s_eval_handle);
+  read_header();
+#endif
+}
+
+#if defined(REVERSI_HOST)
+void eval_set_data(const uint8_t *data, size_t size)
+{
+  s_eval_data = data;
+  s_eval_size = size;
+  read_header();
+}
+#endif
+
+int eval_get_phase(int empties)
+{
+  return min(max((BOARD_WIDTH*BOARD_HEIGHT - 4 - empties) / EVAL_PHASE_EMPTIES, 0), EVAL_PHASES - 1);
+}
+
+//Loads the tables for a position with this many empties.  Both targets are little endian, so they load as is.
+void eval_set_phase(int empties)
+{
+  int phase = eval_get_phase(empties);
+  if(!s_eval_loaded || phase == s_phase)
+  {
+    return;
+  }
+  if(!read_weights(EVAL_HEADER_SIZE + phase * EVAL_TABLE_SIZE * sizeof(int16_t), s_weights, sizeof(s_weights)))
+  {
+    s_eval_loaded = false;
+    return;
+  }
+  s_phase = phase;
+}
+
+//The board's eight symmetric images, so every pattern can be read from the a1 corner with fixed masks.
+static void get_images(uint64_t bits, uint64_t *images)
+{
+  images[0] = bits;
+  images[1] = bitboard_flip_horizontal(bits);
+  images[2] = bitboard_flip_vertical(bits);
+  images[3] = bitboard_flip_vertical(images[1]);
+  for(int i = 0; i < 4; i++)
+  {
+    images[i + 4] = bitboard_flip_diagonal(images[i]);
+  }
+}
+
+static inline int get_index(uint64_t own_bits, uint64_t opp_bits)
+{
+  return s_base3[own_bits] + 2 * s_base3[opp_bits];
+}
+
+static inline uint64_t get_diagonal(uint64_t bits, uint64_t mask, int shift)
+{
+  return ((bits & mask) * COLUMN_GATHER) >> shift;
+}
+
+//Fills features with the table entry each pattern instance and count reads, for the side to move.
+//Branch free: every instance is a few masks and shifts, then two base 3 lookups, and every count a bitboard kernel.
+void eval_get_features(const Position *pos, uint16_t *features)
+{
+  uint64_t own[8];
+  uint64_t opp[8];
+  get_images(pos->discs[pos->player], own);
+  get_images(pos->discs[toggle_player(pos->player)], opp);
+  for(int i = 0; i < 8; i++)
+  {
+    features[i] = CORNER_2X3_TABLE + get_index((own[i] & 0x7) | ((own[i] >> 5) & 0x38), (opp[i] & 0x7) | ((opp[i] >> 5) & 0x38));
+    features[i + 8] = EDGE_6_TABLE + get_index(own[i] & 0x3f, opp[i] & 0x3f);
+  }
+  //The four images without the transpose put each corner at a1 once, and each diagonal's twins are the other three.
+  for(int i = 0; i < 4; i++)
+  {
+    features[i + 16] = CORNER_DIAGONAL_TABLE + get_index(get_diagonal(own[i], CORNER_DIAGONAL_MASK, 56) & 0xf,
+                                                         get_diagonal(opp[i], CORNER_DIAGONAL_MASK, 56) & 0xf);
+    features[i + 20] = DIAGONAL_6_TABLE + get_index(get_diagonal(own[i], DIAGONAL_6_MASK, 58), get_diagonal(opp[i], DIAGONAL_6_MASK, 58));
+    features[i + 24] = DIAGONAL_5_TABLE + get_index(get_diagonal(own[i], DIAGONAL_5_MASK, 59), get_diagonal(opp[i], DIAGONAL_5_MASK, 59));
+    features[i + 28] = DIAGONAL_4_TABLE + get_index(get_diagonal(own[i], DIAGONAL_4_MASK, 60), get_diagonal(opp[i], DIAGONAL_4_MASK, 60));
+  }
+  features[32] = MOBILITY_TABLE + bitboard_count(bitboard_get_moves(own[0], opp[0]));
+  features[33] = MOBILITY_TABLE + COUNT_TABLE_SIZE + bitboard_count(bitboard_get_moves(opp[0], own[0]));
+  features[34] = POTENTIAL_MOBILITY_TABLE + bitboard_count(bitboard_get_potential_moves(own[0], opp[0]));
+  features[35] = POTENTIAL_MOBILITY_TABLE + COUNT_TABLE_SIZE + bitboard_count(bitboard_get_potential_moves(opp[0], own[0]));
+  features[36] = FRONTIER_TABLE + bitboard_count(bitboard_get_frontier(own[0], opp[0]));
+  features[37] = FRONTIER_TABLE + COUNT_TABLE_SIZE + bitboard_count(bitboard_get_frontier(opp[0], own[0]));
+  features[38] = EDGE_STABLE_TABLE + bitboard_count(bitboard_get_edge_stable(own[0], opp[0]));
+  features[39] = EDGE_STABLE_TABLE + COUNT_TABLE_SIZE + bitboard_count(bitboard_get_edge_stable(opp[0], own[0]));
+}
+
+//Heuristic score for the side to move.
+int eval_position(const Position *pos)
+{
+  int own = pos->player;
+  int opp = toggle_player(own);
+  int score = 0;
+  if(s_phase < 0)
+  {
+    //No tables: the original disc count with a bonus for corners.
+    score = (pos->disc_count[own] - pos->disc_count[opp]) + 100 * (pos->corner_count[own] - pos->corner_count[opp]);
+  }
+  else
+  {
+    uint16_t features[EVAL_FEATURES];
+    eval_get_features(pos, features);
+    for(int i = 0; i < EVAL_FEATURES; i++)
+    {
+      score += s_weights[features[i]];
+    }
+  }
+  return min(max(score, -EVAL_LIMIT), EVAL_LIMIT);
+}
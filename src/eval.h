@@ -0,0 +1,32 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+//Pattern evaluation.  Scores are for the side to move, in 1/EVAL_SCALE of a disc of expected final margin.
+//A pattern is a fixed line or block of squares by a corner, read at each of the board's symmetric images.
+//Its squares spell a base 3 index (0 empty, 1 own, 2 opponent's) into an int16 weight table.
+//Each side's mobility, potential mobility, frontier and edge-anchored stable discs are counted too,
+//and each count indexes a table of its own.  The score is the sum of the weights.
+//Each game phase, by empty count, has its own tables.
+#define EVAL_SCALE 8
+#define EVAL_LIMIT 999 //Heuristic scores stay below a won game's 1000.
+#define EVAL_PHASES 6
+#define EVAL_PHASE_EMPTIES 10
+#define EVAL_FEATURES 40 //Pattern instances and counts read per position.
+#define EVAL_TABLE_SIZE 3112 //Weights per phase, over all the patterns and counts.
+
+//Weights resource layout.  Everything is little endian.
+//  header: 'R' 'E' 'V' EVAL_VERSION, then a uint8 phase count
+//  then for each phase, from the opening on: EVAL_TABLE_SIZE int16 weights
+#define EVAL_VERSION 2
+#define EVAL_HEADER_SIZE 5
+
+void eval_init();
+#if defined(REVERSI_HOST)
+void eval_set_data(const uint8_t *data, size_t size);
+#endif
+int eval_get_phase(int empties);
+void eval_set_phase(int empties);
+void eval_get_features(const Position *pos, uint16_t *features);
+int eval_position(const Position *pos);
+
+#endif
@@ -1,4 +1,4 @@
-#include <pebble.h>
+#include "platform.h"
 #include <stdlib.h>
 #include "util.h"
 #include "game.h"
@@ -24,178 +24,423 @@ void reverse_index(int in_index, int *x, int *y)
   *y = (in_index - *x)/BOARD_HEIGHT;
 }
 
-void get_board_score(char *board, int *black_score, int *white_score)
+// Bitboards: one uint64_t mask per color, where bit n is board index n (x + y*BOARD_WIDTH).
+// Moves and flips are found by shifting whole masks in each of the eight directions
+// instead of walking the board square by square.
+#define BB_NOT_A_FILE 0xfefefefefefefefeULL // Every square except x == 0
+#define BB_NOT_H_FILE 0x7f7f7f7f7f7f7f7fULL // Every square except x == 7
+#define BB_ALL 0xffffffffffffffffULL
+#define BB_RANK_1 0x00000000000000ffULL // y == 0
+#define BB_RANK_8 0xff00000000000000ULL // y == 7
+#define BB_FILE_A 0x0101010101010101ULL
+#define BB_FILE_H 0x8080808080808080ULL
+
+// Shift amounts for the eight directions, and the masks that stop a shift wrapping around a row.
+static const int BB_SHIFTS[8] = {1, 9, 8, 7, -1, -9, -8, -7};
+static const uint64_t BB_SHIFT_MASKS[8] = {BB_NOT_A_FILE, BB_NOT_A_FILE, BB_ALL, BB_NOT_H_FILE, BB_NOT_H_FILE, BB_NOT_H_FILE, BB_ALL, BB_NOT_A_FILE};
+
+static inline uint64_t bitboard_shift(uint64_t bits, int dir)
+{
+  int shift = BB_SHIFTS[dir];
+  return ((shift > 0) ? (bits << shift) : (bits >> -shift)) & BB_SHIFT_MASKS[dir];
+}
+
+void board_to_bitboards(char *board, uint64_t *black, uint64_t *white)
 {
-  int black_pieces = 0;
-  int white_pieces = 0;
-  for(int i = 0; i < BOARD_WIDTH; i++)
+  uint64_t black_bits = 0;
+  uint64_t white_bits = 0;
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
   {
-    for(int j= 0; j < BOARD_HEIGHT; j++)
+    if(board[i] == BLACK)
     {
-      if(board[get_board_index(i,j)] == BLACK)
-      {
-        black_pieces += 1;
-      }
-      else if(board[get_board_index(i,j)] == WHITE)
-      {
-        white_pieces += 1;
-      }
+      black_bits |= (1ULL << i);
+    }
+    else if(board[i] == WHITE)
+    {
+      white_bits |= (1ULL << i);
     }
   }
-  *black_score = black_pieces;
-  *white_score = white_pieces;
+  *black = black_bits;
+  *white = white_bits;
 }
 
+int bitboard_count(uint64_t bits)
+{
+  return __builtin_popcountll(bits);
+}
 
-bool select_vector(char* board, int vector_x, int vector_y, int pos_x, int pos_y, int current_player, bool color_line_found, bool mark_if_found)
+// Legal move targets along one line, both ways.  "opp" is pre-masked so a run can't wrap from one row to the next.
+// A run of opponent pieces can be at most six long, so five extra steps cover it.
+static inline uint64_t bitboard_get_line_moves(uint64_t own, uint64_t opp, int shift)
 {
-  char current_player_color = get_player_char(current_player);
-  char other_player_color = (get_player_char(current_player) == BLACK) ? WHITE : BLACK;
-  if (pos_x < 0 || pos_x >= BOARD_WIDTH || pos_y < 0 || pos_y >= BOARD_HEIGHT) //Current location out of bounds.  We reached the end of the board.
+  uint64_t up = opp & (own << shift);
+  uint64_t down = opp & (own >> shift);
+  up |= opp & (up << shift);
+  down |= opp & (down >> shift);
+  up |= opp & (up << shift);
+  down |= opp & (down >> shift);
+  up |= opp & (up << shift);
+  down |= opp & (down >> shift);
+  up |= opp & (up << shift);
+  down |= opp & (down >> shift);
+  up |= opp & (up << shift);
+  down |= opp & (down >> shift);
+  return (up << shift) | (down >> shift);
+}
+
+// Returns a mask of every empty square where the owner of "own" may play.
+uint64_t bitboard_get_moves(uint64_t own, uint64_t opp)
+{
+  uint64_t inner_opp = opp & BB_NOT_A_FILE & BB_NOT_H_FILE;
+  uint64_t moves = bitboard_get_line_moves(own, inner_opp, 1) | bitboard_get_line_moves(own, opp, 8) |
+                   bitboard_get_line_moves(own, inner_opp, 7) | bitboard_get_line_moves(own, inner_opp, 9);
+  return moves & ~(own | opp);
+}
+
+// Opponent pieces captured in one direction from start.  Always inlined with a constant direction,
+// so the shift and mask are compiled in; this is the AI's hottest loop.
+static inline uint64_t bitboard_get_line_flips(uint64_t own, uint64_t opp, uint64_t start, int dir)
+{
+  uint64_t line = 0;
+  uint64_t cursor = bitboard_shift(start, dir);
+  while(cursor & opp)
   {
-    return false;
+    line |= cursor;
+    cursor = bitboard_shift(cursor, dir);
   }
-  if(!color_line_found)
+  return (cursor & own) ? line : 0;
+}
+
+// Returns the mask of opponent pieces that playing at index would flip.  Zero means the move is illegal.
+uint64_t bitboard_get_flips(uint64_t own, uint64_t opp, int index)
+{
+  uint64_t start = 1ULL << index;
+  if((own | opp) & start)
   {
-    if(board[get_board_index(pos_x,pos_y)] == other_player_color) //Color line found!  Flip bit and see if it has a terminator
-    {
-      if(select_vector(board, vector_x, vector_y, pos_x + vector_x, pos_y+ vector_y, current_player, true, mark_if_found))
-      {
-        if(mark_if_found)
-        {
-          board[get_board_index(pos_x,pos_y)] = current_player_color;
-        }
-        return true;
-      }
-      else
-      {
-        return false;
-      }
-    }
-    else // We haven't found a color line yet, and this isn't an opposite color tile, so we're done.  Return false.
-    {
-      return false;
-    }
+    return 0;
   }
-  else// Color line found is true.  If this matches the other_player color, keep going.  If it matches the player color 
+  return bitboard_get_line_flips(own, opp, start, 0) | bitboard_get_line_flips(own, opp, start, 1) |
+         bitboard_get_line_flips(own, opp, start, 2) | bitboard_get_line_flips(own, opp, start, 3) |
+         bitboard_get_line_flips(own, opp, start, 4) | bitboard_get_line_flips(own, opp, start, 5) |
+         bitboard_get_line_flips(own, opp, start, 6) | bitboard_get_line_flips(own, opp, start, 7);
+}
+
+// Every square next to one of the bits, in any of the eight directions.
+static inline uint64_t bitboard_get_neighbours(uint64_t bits)
+{
+  uint64_t sideways = ((bits << 1) & BB_NOT_A_FILE) | ((bits >> 1) & BB_NOT_H_FILE);
+  uint64_t row = bits | sideways;
+  return sideways | (row << 8) | (row >> 8);
+}
+
+// Empty squares next to an opponent disc: where "own" could find moves later, even if it has none there now.
+uint64_t bitboard_get_potential_moves(uint64_t own, uint64_t opp)
+{
+  return bitboard_get_neighbours(opp) & ~(own | opp);
+}
+
+// Discs of "own" next to an empty square.  These give the opponent moves, so fewer is better.
+uint64_t bitboard_get_frontier(uint64_t own, uint64_t opp)
+{
+  return own & bitboard_get_neighbours(~(own | opp));
+}
+
+// Discs of "own" that can never be flipped because they're anchored on an edge: its corners, the unbroken runs of
+// its discs along an edge from them, and every disc on a completely filled edge.  Interior stability is left to the
+// endgame solver, which can afford the full test.
+uint64_t bitboard_get_edge_stable(uint64_t own, uint64_t opp)
+{
+  uint64_t occupied = own | opp;
+  uint64_t full = (BB_RANK_1 & -(uint64_t)((occupied & BB_RANK_1) == BB_RANK_1)) |
+                  (BB_RANK_8 & -(uint64_t)((occupied & BB_RANK_8) == BB_RANK_8)) |
+                  (BB_FILE_A & -(uint64_t)((occupied & BB_FILE_A) == BB_FILE_A)) |
+                  (BB_FILE_H & -(uint64_t)((occupied & BB_FILE_H) == BB_FILE_H));
+  uint64_t corners = own & CORNER_MASK;
+  // Kogge-Stone fills from the corners through own discs, along the top and bottom edges then the sides.
+  uint64_t run = own & (BB_RANK_1 | BB_RANK_8) & BB_NOT_A_FILE;
+  uint64_t east = corners;
+  east |= run & (east << 1);
+  run &= run << 1;
+  east |= run & (east << 2);
+  run &= run << 2;
+  east |= run & (east << 4);
+  run = own & (BB_RANK_1 | BB_RANK_8) & BB_NOT_H_FILE;
+  uint64_t west = corners;
+  west |= run & (west >> 1);
+  run &= run >> 1;
+  west |= run & (west >> 2);
+  run &= run >> 2;
+  west |= run & (west >> 4);
+  run = own & (BB_FILE_A | BB_FILE_H);
+  uint64_t north = corners;
+  north |= run & (north << 8);
+  run &= run << 8;
+  north |= run & (north << 16);
+  run &= run << 16;
+  north |= run & (north << 32);
+  run = own & (BB_FILE_A | BB_FILE_H);
+  uint64_t south = corners;
+  south |= run & (south >> 8);
+  run &= run >> 8;
+  south |= run & (south >> 16);
+  run &= run >> 16;
+  south |= run & (south >> 32);
+  return east | west | north | south | (own & full);
+}
+
+bool bitboard_is_position_selectable(uint64_t own, uint64_t opp, int index)
+{
+  return bitboard_get_flips(own, opp, index) != 0;
+}
+
+// Plays index for the owner of "own", flipping the captured opponent pieces in place.
+void bitboard_commit_selection(uint64_t *own, uint64_t *opp, int index)
+{
+  uint64_t flips = bitboard_get_flips(*own, *opp, index);
+  *own |= flips | (1ULL << index);
+  *opp &= ~flips;
+}
+
+void bitboard_get_score(uint64_t black, uint64_t white, int *black_score, int *white_score)
+{
+  *black_score = bitboard_count(black);
+  *white_score = bitboard_count(white);
+}
+
+// Board symmetries.  Each one is its own inverse.
+// Mirrors a bitboard left to right: (x, y) becomes (7 - x, y).
+uint64_t bitboard_flip_horizontal(uint64_t bits)
+{
+  bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+  bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+  return ((bits >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((bits & 0x0f0f0f0f0f0f0f0fULL) << 4);
+}
+
+// Mirrors a bitboard top to bottom: (x, y) becomes (x, 7 - y).
+uint64_t bitboard_flip_vertical(uint64_t bits)
+{
+  return __builtin_bswap64(bits);
+}
+
+// Mirrors a bitboard in the a1-h8 diagonal: (x, y) becomes (y, x).
+uint64_t bitboard_flip_diagonal(uint64_t bits)
+{
+  uint64_t t = 0x0f0f0f0f00000000ULL & (bits ^ (bits << 28));
+  bits ^= t ^ (t >> 28);
+  t = 0x3333000033330000ULL & (bits ^ (bits << 14));
+  bits ^= t ^ (t >> 14);
+  t = 0x5500550055005500ULL & (bits ^ (bits << 7));
+  bits ^= t ^ (t >> 7);
+  return bits;
+}
+
+// Mirrors a bitboard in the a8-h1 diagonal: (x, y) becomes (7 - y, 7 - x).
+uint64_t bitboard_flip_anti_diagonal(uint64_t bits)
+{
+  uint64_t t = bits ^ (bits << 36);
+  bits ^= 0xf0f0f0f00f0f0f0fULL & (t ^ (bits >> 36));
+  t = 0xcccc0000cccc0000ULL & (bits ^ (bits << 18));
+  bits ^= t ^ (t >> 18);
+  t = 0xaa00aa00aa00aa00ULL & (bits ^ (bits << 9));
+  bits ^= t ^ (t >> 9);
+  return bits;
+}
+
+// Zobrist keys: one random key per square and color, plus one for white to move.
+// They come from a fixed-seed splitmix64 stream so every build and platform agrees on them.
+#define ZOBRIST_SEED 0x5265766572736921ULL // "Reversi!"
+static uint64_t s_zobrist_squares[2][BOARD_WIDTH*BOARD_HEIGHT];
+static uint64_t s_zobrist_white_to_move;
+
+static uint64_t splitmix64(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void init_zobrist_keys()
+{
+  uint64_t state = ZOBRIST_SEED;
+  for(int p = 0; p < 2; p++)
   {
-    if(board[get_board_index(pos_x,pos_y)] == current_player_color)
+    for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
     {
-      return true;
+      s_zobrist_squares[p][i] = splitmix64(&state);
     }
-    else if(board[get_board_index(pos_x,pos_y)] == other_player_color)
+  }
+  s_zobrist_white_to_move = splitmix64(&state);
+}
+
+// Hash from scratch.  make_move/unmake_move keep pos->hash equal to this incrementally.
+uint64_t compute_position_hash(const Position *pos)
+{
+  uint64_t hash = (pos->player == 1) ? s_zobrist_white_to_move : 0;
+  for(int p = 0; p < 2; p++)
+  {
+    for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
     {
-      if(select_vector(board, vector_x, vector_y, pos_x + vector_x, pos_y+ vector_y, current_player, color_line_found, mark_if_found))
+      if(pos->discs[p] & (1ULL << i))
       {
-        if(mark_if_found)
-        {
-          board[get_board_index(pos_x,pos_y)] = current_player_color;
-        }
-        return true;
+        hash ^= s_zobrist_squares[p][i];
       }
-      return false;
     }
-    else //it's empty, or "selectable," which is also empty.
+  }
+  return hash;
+}
+
+// XORs out the old owner and in the new owner of every flipped square, plus the placed piece and the turn.
+// XOR is its own inverse, so make and unmake use the same update.
+static uint64_t get_move_hash_delta(int player, int index, uint64_t flips)
+{
+  uint64_t delta = s_zobrist_white_to_move;
+  if(index != PASS_MOVE)
+  {
+    delta ^= s_zobrist_squares[player][index];
+    while(flips)
     {
-      return false;
+      int sq = __builtin_ctzll(flips);
+      delta ^= s_zobrist_squares[0][sq] ^ s_zobrist_squares[1][sq];
+      flips &= flips - 1;
     }
   }
+  return delta;
+}
+
+void board_to_position(char *board, int current_player, Position *pos)
+{
+  uint64_t black = 0;
+  uint64_t white = 0;
+  board_to_bitboards(board, &black, &white);
+  bitboards_to_position(black, white, current_player, pos);
 }
 
-void select_position(char* board, int i, int j, int current_player)
+void bitboards_to_position(uint64_t black, uint64_t white, int current_player, Position *pos)
 {
-  for(int x = -1; x <= 1; x++)
+  pos->discs[0] = black;
+  pos->discs[1] = white;
+  pos->player = current_player;
+  for(int p = 0; p < 2; p++)
   {
-    for(int y = -1; y <= 1; y++)
+    pos->disc_count[p] = bitboard_count(pos->discs[p]);
+    pos->corner_count[p] = bitboard_count(pos->discs[p] & CORNER_MASK);
+  }
+  pos->empties = (BOARD_WIDTH*BOARD_HEIGHT) - pos->disc_count[0] - pos->disc_count[1];
+  pos->hash = compute_position_hash(pos);
+}
+
+// Plays index (or PASS_MOVE) for the side to move and hands the turn over.
+// Only the flipped squares are recorded, so the undo record stays small.
+void make_move(Position *pos, int index, MoveUndo *undo)
+{
+  int own = pos->player;
+  int opp = toggle_player(own);
+  undo->index = index;
+  undo->flips = 0;
+  undo->flip_count = 0;
+  if(index != PASS_MOVE)
+  {
+    uint64_t placed = 1ULL << index;
+    undo->flips = bitboard_get_flips(pos->discs[own], pos->discs[opp], index);
+    undo->flip_count = bitboard_count(undo->flips);
+    pos->discs[own] ^= undo->flips | placed;
+    pos->discs[opp] ^= undo->flips;
+    pos->disc_count[own] += undo->flip_count + 1;
+    pos->disc_count[opp] -= undo->flip_count;
+    pos->empties--;
+    if(placed & CORNER_MASK)
     {
-      if(y == 0 && x == 0)//skip the cell itself.
-      {
-        continue;
-      }
-      if (x+i < 0 || x+i >= BOARD_WIDTH || y+j < 0 || y+j >= BOARD_HEIGHT)
-      {
-        continue;
-      }
-      select_vector(board,x,y,i+x,j+y,current_player,false,true);
+      pos->corner_count[own]++;
     }
   }
+  pos->hash ^= get_move_hash_delta(own, index, undo->flips);
+  pos->player = opp;
 }
 
-void commit_selection(char *board, int i, int j, int current_player)
+void unmake_move(Position *pos, const MoveUndo *undo)
 {
-  // Add the current character to the board
-  char new_piece = get_player_char(current_player);
-  int new_idx = get_board_index(i,j);
-  board[new_idx] = new_piece;
-  // Run select_position
-  select_position(board, i, j, current_player);
+  int own = toggle_player(pos->player);
+  int opp = pos->player;
+  if(undo->index != PASS_MOVE)
+  {
+    uint64_t placed = 1ULL << undo->index;
+    pos->discs[own] ^= undo->flips | placed;
+    pos->discs[opp] ^= undo->flips;
+    pos->disc_count[own] -= undo->flip_count + 1;
+    pos->disc_count[opp] += undo->flip_count;
+    pos->empties++;
+    if(placed & CORNER_MASK)
+    {
+      pos->corner_count[own]--;
+    }
+  }
+  pos->hash ^= get_move_hash_delta(own, undo->index, undo->flips);
+  pos->player = own;
+}
 
+// Finds the side to move's legal moves and reports whether it must pass or the game is over.
+int get_move_status(const Position *pos, uint64_t *moves)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  *moves = bitboard_get_moves(own, opp);
+  if(*moves != 0)
+  {
+    return MOVES_AVAILABLE;
+  }
+  return (bitboard_get_moves(opp, own) != 0) ? MOVES_MUST_PASS : MOVES_GAME_OVER;
 }
 
-bool is_position_selectable(char* board, int i, int j, int current_player)
+// Fills list with every legal move for the side to move, in board index order.  Returns the list status.
+int generate_move_list(const Position *pos, MoveList *list)
 {
-  // Check the eight neighboring squares.  
-  // If any of them are the opposite of the current_player color,
-  // Continue to check neighbors along that vector until you
-  // A) Hit a square that is the current_player color (return true)
-  // B) Hit a square that is empty (return false)
-  // C) Hit the edge of the board (return false)
-  for(int x = -1; x <= 1; x++)
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  list->status = get_move_status(pos, &list->mask);
+  list->count = 0;
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
   {
-    for(int y = -1; y <= 1; y++)
+    if(list->mask & (1ULL << i))
     {
-      if(y == 0 && x == 0)//skip the cell itself.
-      {
-        continue;
-      }
-      if (x+i < 0 || x+i >= BOARD_WIDTH || y+j < 0 || y+j >= BOARD_HEIGHT)
-      {
-        continue;
-      }
-      if(select_vector(board,x,y,i+x,j+y,current_player,false,false))
-      {
-        return true;
-      }
+      list->moves[list->count].index = i;
+      list->moves[list->count].flips = bitboard_get_flips(own, opp, i);
+      list->count++;
     }
   }
-  return false;
+  return list->status;
 }
 
-//Returns the number of selectable locations found;
-int set_board_selectables_and_score(char *board, int *black_score, int *white_score, int current_player)
+void get_board_score(char *board, int *black_score, int *white_score)
+{
+  uint64_t black = 0;
+  uint64_t white = 0;
+  board_to_bitboards(board, &black, &white);
+  bitboard_get_score(black, white, black_score, white_score);
+}
+
+void commit_selection(char *board, int i, int j, int current_player)
+{
+  Position pos;
+  board_to_position(board, current_player, &pos);
+  Move move;
+  move.index = get_board_index(i,j);
+  move.flips = bitboard_get_flips(pos.discs[current_player], pos.discs[toggle_player(current_player)], move.index);
+  commit_move(board, &move, current_player);
+}
+
+// Writes a move from a MoveList onto a board without searching for its flips again.
+void commit_move(char *board, const Move *move, int current_player)
 {
-  int black_pieces = 0;
-  int white_pieces = 0;
-  int selectable_positions = 0;
-  for(int i = 0; i < BOARD_WIDTH; i++)
+  char new_piece = get_player_char(current_player);
+  board[move->index] = new_piece;
+  for(int idx = 0; idx < BOARD_WIDTH*BOARD_HEIGHT; idx++)
   {
-    for(int j= 0; j < BOARD_HEIGHT; j++)
+    if(move->flips & (1ULL << idx))
     {
-      if(board[get_board_index(i,j)] == BLACK)
-      {
-        black_pieces += 1;
-      }
-      else if(board[get_board_index(i,j)] == WHITE)
-      {
-        white_pieces += 1;
-      }
-      else// if already selectable, or empty
-      {
-        if(is_position_selectable(board, i, j, current_player))
-        {
-          board[get_board_index(i,j)] = SELECTABLE;
-          selectable_positions++;
-        }
-        else
-        {
-          board[get_board_index(i,j)] = EMPTY;
-        }
-      }
+      board[idx] = new_piece;
     }
   }
-  *black_score = black_pieces;
-  *white_score = white_pieces;
-  return selectable_positions;
 }
 
 int toggle_player(int in_player)
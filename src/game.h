@@ -1,13 +1,85 @@
 #ifndef GAME_H
 #define GAME_H
 
+#define CORNER_MASK 0x8100000000000081ULL // The four corner squares
+
+//A position the AI can search in place: one bitboard per color plus the side to move.
+//The counts are kept up to date by make_move/unmake_move so evaluation never scans the board.
+typedef struct {
+  uint64_t discs[2]; //Indexed by player: 0 is black, 1 is white.
+  int player; //Side to move.
+  int disc_count[2];
+  int empties;
+  int corner_count[2]; //Corners can never be flipped, so these only change when a corner is played.
+  uint64_t hash; //Zobrist key of the discs and the side to move.
+} Position;
+
+//Everything make_move changed, so unmake_move can put it back exactly.
+typedef struct {
+  uint64_t flips;
+  int flip_count;
+  int index; //PASS_MOVE for a pass.
+} MoveUndo;
+
+#define PASS_MOVE -1
+
+//A legal move and the opponent pieces it flips.
+typedef struct {
+  uint64_t flips;
+  int index;
+} Move;
+
+//No reachable position has more legal moves than this.
+#define MAX_MOVES 33
+
+//Move list status.
+#define MOVES_AVAILABLE 0
+#define MOVES_MUST_PASS 1 //The side to move has no moves, but the opponent does.
+#define MOVES_GAME_OVER 2 //Neither side can move.
+
+//Every legal move for the side to move, without touching the board.
+typedef struct {
+  Move moves[MAX_MOVES];
+  int count;
+  uint64_t mask; //Bit n is set if index n is in moves.
+  int status;
+} MoveList;
+
 int get_board_index(int x, int y);
 char get_board_value(int index, char *board);
 void reverse_index(int in_index, int *x, int *y);
 char get_player_char(int in_player);
 void get_board_score(char *board, int *black_score, int *white_score);
 void commit_selection(char *board, int i, int j, int current_player);
-int set_board_selectables_and_score(char *board, int *black_score, int *white_score, int current_player);
+void commit_move(char *board, const Move *move, int current_player);
 int toggle_player(int in_player);
 
+//Bitboard versions, used by the AI.  Bit n of a mask is board index n.
+void board_to_bitboards(char *board, uint64_t *black, uint64_t *white);
+int bitboard_count(uint64_t bits);
+uint64_t bitboard_get_moves(uint64_t own, uint64_t opp);
+uint64_t bitboard_get_flips(uint64_t own, uint64_t opp, int index);
+uint64_t bitboard_get_potential_moves(uint64_t own, uint64_t opp);
+uint64_t bitboard_get_frontier(uint64_t own, uint64_t opp);
+uint64_t bitboard_get_edge_stable(uint64_t own, uint64_t opp);
+bool bitboard_is_position_selectable(uint64_t own, uint64_t opp, int index);
+void bitboard_commit_selection(uint64_t *own, uint64_t *opp, int index);
+void bitboard_get_score(uint64_t black, uint64_t white, int *black_score, int *white_score);
+uint64_t bitboard_flip_horizontal(uint64_t bits);
+uint64_t bitboard_flip_vertical(uint64_t bits);
+uint64_t bitboard_flip_diagonal(uint64_t bits);
+uint64_t bitboard_flip_anti_diagonal(uint64_t bits);
+
+//Zobrist keys.  Call init_zobrist_keys() once at startup, before building any Position.
+void init_zobrist_keys();
+uint64_t compute_position_hash(const Position *pos);
+
+//Incremental move making on a Position.
+void board_to_position(char *board, int current_player, Position *pos);
+void bitboards_to_position(uint64_t black, uint64_t white, int current_player, Position *pos);
+void make_move(Position *pos, int index, MoveUndo *undo);
+void unmake_move(Position *pos, const MoveUndo *undo);
+int get_move_status(const Position *pos, uint64_t *moves);
+int generate_move_list(const Position *pos, MoveList *list);
+
 #endif
\ No newline at end of file
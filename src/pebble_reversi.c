@@ -2,8 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "util.h"
-#include "ai.h"
 #include "game.h"
+#include "ai.h"
+#include "ai_worker.h"
+#include "book.h"
+#include "eval.h"
+#include "stats.h"
 
 #ifdef PBL_SDK_3
 //Status bar support for SDK 3
@@ -21,6 +25,10 @@ static SimpleMenuItem settings_menu_item_array [5];
 
 //Debug Variables
 static const bool SPECIAL_SCREENSHOT_MODE = false;
+#if AI_STATS
+static const bool SHOW_SEARCH_STATS = true; //Draw the last search's statistics over the bottom of the board.
+static char g_stats_text[48] = "";
+#endif
 
 //AI Window
 static Window *ai_settings_window;
@@ -40,9 +48,20 @@ static TextLayer *text_layer;
 static TextLayer *black_score_layer;
 static TextLayer *white_score_layer;
 static Layer *s_canvas_layer;
+#define CIRCLE_SIZE 16
+#define BOARD_LEFT_OFFSET 8
+#define BOARD_TOP_OFFSET (22 + TOP_BAR_OFFSET)
+#ifdef PBL_COLOR
+  #define BOARD_BACKGROUND_COLOR ((GColor8){ .argb = 0b11001100 })
+#else
+  #define BOARD_BACKGROUND_COLOR GColorWhite
+#endif
+static uint8_t g_drawn_cells[BOARD_WIDTH*BOARD_HEIGHT]; //What each cell showed when the canvas was last drawn.
+static bool g_redraw_board = true; //Something else drew over the canvas, so all of it has to be drawn again.
 
 //Animation state stuff
 #define ANIM_FRAME_SPEED 50
+#define AI_SLICE_DELAY 10 //Pause between AI search slices, for input and redraws.
 static char g_old_board[BOARD_WIDTH*BOARD_HEIGHT];
 static char g_anim_board[BOARD_WIDTH*BOARD_HEIGHT];
 static int anim_state = 0;
@@ -66,19 +85,34 @@ static int ai_strength = 1;
 static bool g_grid_display = false;
 
 //Stuff that'll get reconstructed once the game is restored.
-static int g_selected_square = 0; //An index into g_selectable_array
-static int g_selectable_array[BOARD_WIDTH*BOARD_HEIGHT];
-static int g_selectable_count = 0; //Number of selctable elements in g_selectable_array
+static int g_selected_square = 0; //An index into g_moves.moves
+static Position g_position; //g_board as bitboards, with g_current_player to move
+static MoveList g_moves; //The current player's legal moves
 
 //Current Board Score
 static int g_white_score = 0;
 static int g_black_score = 0;
+static int g_shown_white_score = -1; //What the score layers show, -1 before they show anything.
+static int g_shown_black_score = -1;
 static char *g_black_score_string = "00"; //Different because otherwise the compiler sets the two strings to the same address, amazing.
 static char *g_white_score_string = "02";
 
 //AI Strength.  
 //0= Random selection from available moves
 static bool ai_thinking = false;
+static int ai_book_move = -1; //The opening book's move for this turn, -1 if it has none.
+
+//Pondering.  In 1 player games the AI searches its replies while the human chooses, the highlighted move's first.
+//Once the human moves, the search or result for that move carries on as the AI's own, and the rest are dropped.
+#define PONDER_OFF 0
+#define PONDER_CHOOSING 1 //The human is choosing.
+#define PONDER_PLAYED 2 //The human played ponder_move.
+#define PONDER_UNSEARCHED -2 //In ponder_replies.  PASS_MOVE means the AI has no reply to search.
+static int ponder_state = PONDER_OFF;
+static int ponder_move = -1; //Human move whose reply is being searched, -1 for none.
+static int8_t ponder_replies[BOARD_WIDTH*BOARD_HEIGHT]; //The AI's reply to each human move, by the move's index.
+static uint64_t ponder_hash; //Of the position the human's move made, once played.
+static AppTimer *ponder_timer;
 //static int ai_boards_in_memory = 0; // Safeguard against OOMing.
 
 
@@ -90,16 +124,22 @@ static void set_players_turn_display();
 static void set_ai_thinking_display();
 static void restore_game_state();
 static void set_settings_menu_grid_item();
+static void update_pondering();
+static void async_ponder();
 
 
 static int get_current_selectable_index()
 {
-  return g_selectable_array[g_selected_square];
+  if(g_moves.count == 0)
+  {
+    return -1;
+  }
+  return g_moves.moves[g_selected_square].index;
 }
 
 static void inc_selectable_index()
 {
-  if((g_selected_square + 1) >= g_selectable_count)
+  if((g_selected_square + 1) >= g_moves.count)
   {
     g_selected_square = 0;
   }
@@ -113,7 +153,7 @@ static void dec_selectable_index()
 {
   if((g_selected_square - 1) < 0)
   {
-    g_selected_square = max((g_selectable_count-1), 0);//In case this is a decrement when there are no selectables, which should never happen.
+    g_selected_square = max((g_moves.count-1), 0);//In case this is a decrement when there are no selectables, which should never happen.
   }
   else
   {
@@ -121,36 +161,16 @@ static void dec_selectable_index()
   }
 }
 
-static void clear_selectable_array()
+//Rebuilds the current player's move list and the scores from g_board.
+static void update_moves_and_score()
 {
-  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
-  {
-    //clear all 
-    g_selectable_array[i] = -1;
-  }
-  g_selectable_count = 0;
+  board_to_position(g_board, g_current_player, &g_position);
+  generate_move_list(&g_position, &g_moves);
+  g_black_score = g_position.disc_count[0];
+  g_white_score = g_position.disc_count[1];
   g_selected_square = 0;
 }
 
-static void append_selectable_index(int index)
-{
-  g_selectable_array[g_selectable_count] = index;
-  g_selectable_count++;
-}
-
-static void generate_selectables_array()
-{
-  clear_selectable_array();
-  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
-  {
-    //clear all 
-    if(g_board[i] == SELECTABLE)
-    {
-      append_selectable_index(i);
-    }
-  }
-}
-
 static void set_board_to_new()
 {
   for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
@@ -173,13 +193,12 @@ static void reset_game()
 {
   set_initial_player();
   set_board_to_new();
-  set_board_selectables_and_score(g_board, &g_black_score, &g_white_score, g_current_player);
-  generate_selectables_array();
-  g_selected_square = 0;
+  update_moves_and_score();
   if(g_player_count > 0)
   {
     g_current_game_state = BLACK_PLAYER_SELECTING;
     set_players_turn_display();
+    update_pondering();
   }
   else
   {
@@ -202,11 +221,126 @@ static int get_play_frame_from_anim_frame(int cur_frame){
   }
 }
 
+//What a cell shows.  The canvas keeps what it last drew in each cell, and each frame only redraws the ones that differ.
+#define CELL_EMPTY 0
+#define CELL_CORNER 1 //Empty, with the corner marker.
+#define CELL_BLACK 2
+#define CELL_WHITE 3
+#define CELL_MOVE 4 //A legal move's dot.
+#define CELL_SELECTED_BLACK 5 //The highlighted move, with black to play it.
+#define CELL_SELECTED_WHITE 6
+#define CELL_FLIPPING 7 //Plus the frame of the flip animation.
+
+static uint8_t get_cell_look(int index, char *active_board, bool animating)
+{
+  char value = get_board_value(index, active_board);
+  if(value == WHITE)
+  {
+    return CELL_WHITE;
+  }
+  else if(value == BLACK)
+  {
+    return CELL_BLACK;
+  }
+  else if(value == ANIMATING && animating)
+  {
+    return CELL_FLIPPING + get_play_frame_from_anim_frame(anim_frame);
+  }
+  else if(value == EMPTY && (g_moves.mask & (1ULL << index)) && !animating)//Don't render selectables while animating.
+  {
+    if(index == get_current_selectable_index())
+    {
+      return (get_player_char(g_current_player) == WHITE) ? CELL_SELECTED_WHITE : CELL_SELECTED_BLACK;
+    }
+    return CELL_MOVE;
+  }
+  else if(value == EMPTY && (CORNER_MASK & (1ULL << index)))
+  {
+    return CELL_CORNER;
+  }
+  return CELL_EMPTY;
+}
+
+//Puts cell i,j back to bare board: its background and the grid lines on its top and left edges, or all four on the
+//board's bottom and right edges.  A flip frame is a pixel wider and taller than a cell, so the edge cells take the pixel
+//beyond them too.
+static void clear_cell(GContext *ctx, int i, int j)
+{
+  int x = i*CIRCLE_SIZE + BOARD_LEFT_OFFSET;
+  int y = j*CIRCLE_SIZE + BOARD_TOP_OFFSET;
+  int width = CIRCLE_SIZE + (i == BOARD_WIDTH - 1);
+  int height = CIRCLE_SIZE + (j == BOARD_HEIGHT - 1);
+  graphics_context_set_fill_color(ctx, BOARD_BACKGROUND_COLOR);
+  graphics_fill_rect(ctx, GRect(x, y, width, height), 0, GCornerNone);
+  graphics_context_set_fill_color(ctx, GColorBlack);
+  if(g_grid_display)
+  {
+    for(int line_x = x; line_x < x + width; line_x += CIRCLE_SIZE)
+    {
+      graphics_draw_line(ctx, GPoint(line_x, y), GPoint(line_x, y + height - 1));
+    }
+    for(int line_y = y; line_y < y + height; line_y += CIRCLE_SIZE)
+    {
+      graphics_draw_line(ctx, GPoint(x, line_y), GPoint(x + width - 1, line_y));
+    }
+  }
+}
+
+static void draw_cell(GContext *ctx, int i, int j, uint8_t look)
+{
+  if(look == CELL_WHITE)
+  {
+    //graphics_draw_circle(ctx, GPoint((i*CIRCLE_SIZE)+CIRCLE_SIZE/2 + BOARD_LEFT_OFFSET -1, (j*CIRCLE_SIZE)+CIRCLE_SIZE/2 + BOARD_TOP_OFFSET -1), CIRCLE_SIZE/2);
+    #ifdef PBL_COLOR
+      graphics_context_set_fill_color(ctx, GColorWhite);
+      graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8, GCornersAll);
+      graphics_context_set_fill_color(ctx, GColorBlack);
+    #else
+      graphics_draw_round_rect(ctx, GRect(i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8);
+    #endif
+  }
+  else if(look == CELL_BLACK)
+  {
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8, GCornersAll);
+  }
+  else if(look >= CELL_FLIPPING)
+  {
+    #ifdef PBL_COLOR
+    graphics_context_set_compositing_mode(ctx, GCompOpSet);
+    #else
+    graphics_context_set_compositing_mode(ctx, GCompOpAnd);
+    #endif
+    graphics_draw_bitmap_in_rect(ctx, flip_white[look - CELL_FLIPPING], (GRect) { .origin = { i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET }, .size = {17,17} });
+    graphics_context_set_compositing_mode(ctx, GCompOpAnd);
+  }
+  else if(look == CELL_SELECTED_WHITE)
+  {
+    //graphics_draw_circle(ctx, GPoint((i*CIRCLE_SIZE)+CIRCLE_SIZE/2 +BOARD_LEFT_OFFSET -1, (j*CIRCLE_SIZE)+CIRCLE_SIZE/2 + BOARD_TOP_OFFSET -1), CIRCLE_SIZE/2);
+    graphics_draw_round_rect(ctx, GRect(i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8);
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 +BOARD_LEFT_OFFSET, j*CIRCLE_SIZE+6 + BOARD_TOP_OFFSET, 4, 4), 0, GCornersAll);
+  }
+  else if(look == CELL_SELECTED_BLACK)
+  {
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE + BOARD_TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 7, GCornersAll);
+    graphics_context_set_fill_color(ctx, GColorWhite);
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE+6 + BOARD_TOP_OFFSET, 4, 4), 0, GCornersAll);
+    graphics_context_set_fill_color(ctx, GColorBlack);
+  }
+  else if(look == CELL_MOVE)
+  {
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE+6 + BOARD_TOP_OFFSET, 4, 4), 0, GCornersAll);
+  }
+  else if(look == CELL_CORNER)
+  {
+    //Draw the corner indicators
+    graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+7 + BOARD_LEFT_OFFSET, j*CIRCLE_SIZE+7 + BOARD_TOP_OFFSET, 2, 2), 0, GCornerNone);
+  }
+}
+
+//The window has no background of its own, so cells that aren't drawn again keep the last frame's pixels, and only the
+//cells that look different are cleared and drawn.  With g_redraw_board set, the whole canvas is.
 static void write_board_to_layer(Layer *this_layer, GContext *ctx)
 {
-  const int TOP_OFFSET = 22 + TOP_BAR_OFFSET;
-  const int LEFT_OFFSET = 8;
-  const int CIRCLE_SIZE = 16;
   graphics_context_set_fill_color(ctx, GColorBlack);
   char *active_board;
   bool animating = false;
@@ -220,94 +354,99 @@ static void write_board_to_layer(Layer *this_layer, GContext *ctx)
   {
     active_board = g_board;
   }
-  //draw grid
-  if(g_grid_display)
+  if(g_redraw_board)
+  {
+    graphics_context_set_fill_color(ctx, BOARD_BACKGROUND_COLOR);
+    graphics_fill_rect(ctx, layer_get_bounds(this_layer), 0, GCornerNone);
+    graphics_context_set_fill_color(ctx, GColorBlack);
+  }
+  uint8_t looks[BOARD_WIDTH*BOARD_HEIGHT];
+  uint64_t changed = 0;
+  uint64_t was_flipping = 0;
+  uint64_t flipping = 0;
+  for(int index = 0; index < BOARD_WIDTH*BOARD_HEIGHT; index++)
+  {
+    looks[index] = get_cell_look(index, active_board, animating);
+    if(g_redraw_board || looks[index] != g_drawn_cells[index])
+    {
+      changed |= 1ULL << index;
+    }
+    if(g_drawn_cells[index] >= CELL_FLIPPING)
+    {
+      was_flipping |= 1ULL << index;
+    }
+    if(looks[index] >= CELL_FLIPPING)
+    {
+      flipping |= 1ULL << index;
+    }
+  }
+  //A flip frame's spill has to be cleared with it, and a cleared cell has to take the flip frames that spill into it.
+  //Bit n is board index n, x + y*BOARD_WIDTH, so a shift by 1 is a step right and by BOARD_WIDTH a step down.
+  const uint64_t NOT_LEFT_COLUMN = 0xFEFEFEFEFEFEFEFEULL;
+  const uint64_t NOT_RIGHT_COLUMN = 0x7F7F7F7F7F7F7F7FULL;
+  uint64_t cleared = 0;
+  uint64_t grown = changed;
+  while(grown != cleared)
+  {
+    cleared = grown;
+    uint64_t spills = cleared & (was_flipping | flipping);
+    grown |= ((spills << 1) & NOT_LEFT_COLUMN) | (spills << BOARD_WIDTH) | ((spills << (BOARD_WIDTH + 1)) & NOT_LEFT_COLUMN);
+    grown |= (((cleared >> 1) & NOT_RIGHT_COLUMN) | (cleared >> BOARD_WIDTH) | ((cleared >> (BOARD_WIDTH + 1)) & NOT_RIGHT_COLUMN)) & flipping;
+  }
+  if(!g_redraw_board)
+  {
+    for(uint64_t cells = cleared; cells != 0; cells &= cells - 1)
+    {
+      int index = __builtin_ctzll(cells);
+      clear_cell(ctx, index % BOARD_WIDTH, index / BOARD_WIDTH);
+    }
+  }
+  else if(g_grid_display)
   {
     //Render the board first, behind the play area
     int board_total_width = BOARD_WIDTH * CIRCLE_SIZE;
     for(int i = 0; i <= BOARD_WIDTH; i++)
     {
-      int cur_x = (i * CIRCLE_SIZE) + LEFT_OFFSET;
-      GPoint origin = GPoint(cur_x, TOP_OFFSET);
-      GPoint dest = GPoint(cur_x, TOP_OFFSET+board_total_width);
+      int cur_x = (i * CIRCLE_SIZE) + BOARD_LEFT_OFFSET;
+      GPoint origin = GPoint(cur_x, BOARD_TOP_OFFSET);
+      GPoint dest = GPoint(cur_x, BOARD_TOP_OFFSET+board_total_width);
       graphics_draw_line(ctx, origin, dest);
     }
     for(int i = 0; i <= BOARD_WIDTH; i++)
     {
-      int cur_y = (i * CIRCLE_SIZE) + TOP_OFFSET;
-      GPoint origin = GPoint(LEFT_OFFSET, cur_y);
-      GPoint dest = GPoint(LEFT_OFFSET+board_total_width, cur_y);
+      int cur_y = (i * CIRCLE_SIZE) + BOARD_TOP_OFFSET;
+      GPoint origin = GPoint(BOARD_LEFT_OFFSET, cur_y);
+      GPoint dest = GPoint(BOARD_LEFT_OFFSET+board_total_width, cur_y);
       graphics_draw_line(ctx, origin, dest);
     }
   }
+  //Column by column, as the board has always been drawn, so overlapping flip frames overlap the same way.
   for(int i = 0; i < BOARD_WIDTH; i++)
   {
     for(int j = 0; j < BOARD_HEIGHT; j++)
     {
       int index = i + (j*BOARD_WIDTH);
-      if(get_board_value(index, active_board) == WHITE)
-      {
-        //graphics_draw_circle(ctx, GPoint((i*CIRCLE_SIZE)+CIRCLE_SIZE/2 + LEFT_OFFSET -1, (j*CIRCLE_SIZE)+CIRCLE_SIZE/2 + TOP_OFFSET -1), CIRCLE_SIZE/2);
-        #ifdef PBL_COLOR
-          graphics_context_set_fill_color(ctx, GColorWhite);
-          graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8, GCornersAll);
-          graphics_context_set_fill_color(ctx, GColorBlack);
-        #else
-          graphics_draw_round_rect(ctx, GRect(i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8);
-        #endif
-      }
-      else if(get_board_value(index, active_board) == BLACK)
+      if(cleared & (1ULL << index))
       {
-        graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8, GCornersAll);
-      }
-      else if(get_board_value(index, active_board) == ANIMATING && animating)
-      {
-        #ifdef PBL_COLOR
-        graphics_context_set_compositing_mode(ctx, GCompOpSet);
-        #else
-        graphics_context_set_compositing_mode(ctx, GCompOpAnd);
-        #endif
-        graphics_draw_bitmap_in_rect(ctx, flip_white[get_play_frame_from_anim_frame(anim_frame)], (GRect) { .origin = { i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET }, .size = {17,17} });
-        graphics_context_set_compositing_mode(ctx, GCompOpAnd);
-      }
-      else if(get_board_value(index, active_board) == SELECTABLE && !animating)//Don't render selectables while animating.
-      {
-        if(index == get_current_selectable_index())
-        {
-          if(get_player_char(g_current_player) == WHITE)
-          {
-            //graphics_draw_circle(ctx, GPoint((i*CIRCLE_SIZE)+CIRCLE_SIZE/2 +LEFT_OFFSET -1, (j*CIRCLE_SIZE)+CIRCLE_SIZE/2 + TOP_OFFSET -1), CIRCLE_SIZE/2);
-            graphics_draw_round_rect(ctx, GRect(i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 8);
-            graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 +LEFT_OFFSET, j*CIRCLE_SIZE+6 + TOP_OFFSET, 4, 4), 0, GCornersAll);
-          }
-          else
-          {
-            graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE + LEFT_OFFSET, j*CIRCLE_SIZE + TOP_OFFSET, CIRCLE_SIZE, CIRCLE_SIZE), 7, GCornersAll);
-            graphics_context_set_fill_color(ctx, GColorWhite);
-            graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 + LEFT_OFFSET, j*CIRCLE_SIZE+6 + TOP_OFFSET, 4, 4), 0, GCornersAll);
-            graphics_context_set_fill_color(ctx, GColorBlack);
-          }
-        }
-        else
-        {
-          graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+6 + LEFT_OFFSET, j*CIRCLE_SIZE+6 + TOP_OFFSET, 4, 4), 0, GCornersAll);
-        }
-      }
-      else if(get_board_value(index, active_board) == EMPTY)
-      {
-        //graphics_fill_rect(ctx, GRect(i*18+9, j*18+9, 2, 2), 0, GCornersAll);
-        int top_right = get_board_index(0,7);
-        int bottom_left =  get_board_index(7,0);
-        int bottom_right =  get_board_index(7,7);
-
-        if(index == 0 || index == top_right || index == bottom_left || index == bottom_right)
-        {
-          //Draw the corner indicators
-          graphics_fill_rect(ctx, GRect(i*CIRCLE_SIZE+7 + LEFT_OFFSET, j*CIRCLE_SIZE+7 + TOP_OFFSET, 2, 2), 0, GCornerNone);
-        }
+        draw_cell(ctx, i, j, looks[index]);
       }
     }
   }
+  memcpy(g_drawn_cells, looks, sizeof(g_drawn_cells));
+  g_redraw_board = false;
+#if AI_STATS
+  if(SHOW_SEARCH_STATS && g_stats_text[0] != '\0')
+  {
+    GRect bounds = layer_get_bounds(this_layer);
+    GRect text_box = GRect(0, bounds.size.h - 18, bounds.size.w, 18);
+    graphics_context_set_compositing_mode(ctx, GCompOpAssign);
+    graphics_context_set_fill_color(ctx, GColorWhite);
+    graphics_fill_rect(ctx, text_box, 0, GCornerNone);
+    graphics_context_set_text_color(ctx, GColorBlack);
+    graphics_draw_text(ctx, g_stats_text, fonts_get_system_font(FONT_KEY_GOTHIC_14), text_box, GTextOverflowModeTrailingEllipsis,
+                       GTextAlignmentCenter, NULL);
+  }
+#endif
 }
 
 static void reset_text_color() {
@@ -315,20 +454,32 @@ static void reset_text_color() {
   text_layer_set_background_color(text_layer, GColorClear);
 }
 
+//Only a score that changed is set again, so a layer that shows the same number isn't invalidated.
 static void update_score_display()
 {
-  snprintf(g_black_score_string,3, "%d", g_black_score);
-  snprintf(g_white_score_string,3, "%d", g_white_score);
-  text_layer_set_text(black_score_layer, g_black_score_string);
-  text_layer_set_text(white_score_layer, g_white_score_string);
-  layer_mark_dirty(text_layer_get_layer(black_score_layer));
-  layer_mark_dirty(text_layer_get_layer(white_score_layer));
+  if(g_black_score != g_shown_black_score)
+  {
+    snprintf(g_black_score_string,3, "%d", g_black_score);
+    text_layer_set_text(black_score_layer, g_black_score_string);
+    layer_mark_dirty(text_layer_get_layer(black_score_layer));
+    g_shown_black_score = g_black_score;
+  }
+  if(g_white_score != g_shown_white_score)
+  {
+    snprintf(g_white_score_string,3, "%d", g_white_score);
+    text_layer_set_text(white_score_layer, g_white_score_string);
+    layer_mark_dirty(text_layer_get_layer(white_score_layer));
+    g_shown_white_score = g_white_score;
+  }
 }
 static void set_text_box(char *top_string)
 {
   reset_text_color();
   text_layer_set_text(text_layer, top_string);
   layer_mark_dirty(text_layer_get_layer(text_layer));
+  //It has no background, so the old text only goes when the canvas draws over it.
+  g_redraw_board = true;
+  layer_mark_dirty(s_canvas_layer);
 }
 
 static void set_game_over_display()
@@ -418,7 +569,7 @@ static void advance_state()
   else if(g_current_game_state == ANIMATION_PLAYING)
   {
     //Should be switched to the new player.  See if they have any moves available.
-    if(g_selectable_count > 0)
+    if(g_moves.status == MOVES_AVAILABLE)
     {
       // If yes, check to see if the current player is an AI
         //If they are, switch to AI_THINKING.
@@ -441,6 +592,7 @@ static void advance_state()
         {
           set_players_turn_display();
           g_current_game_state = BLACK_PLAYER_SELECTING;
+          update_pondering();
         }
         else
         { 
@@ -449,28 +601,17 @@ static void advance_state()
         }
       }
     }
+    else if(g_moves.status == MOVES_GAME_OVER)
+    {
+      //If neither player has moves available, switch to GAME_OVER
+      set_game_over_display();
+      g_current_game_state = GAME_OVER;
+    }
     else
     {
-      //If no, test to see if the old player has moves available.
-      int new_black_score = 0;
-      int new_white_score = 0;
-      int not_current_player = toggle_player(g_current_player);
-      set_board_selectables_and_score(g_board, &new_black_score, &new_white_score, not_current_player);
-      generate_selectables_array();
-      if(g_selectable_count == 0)
-      {
-        //If neither player has moves available, switch to GAME_OVER
-        set_game_over_display();
-        g_current_game_state = GAME_OVER;
-      }
-      else
-      {
-        //If just the current player has to skip, change BACK to the new player and switch to PLAYER MUST SKIP.
-        set_board_selectables_and_score(g_board, &new_black_score, &new_white_score, g_current_player);
-        generate_selectables_array();
-        set_must_skip_display();
-        g_current_game_state = PLAYER_MUST_SKIP;
-      }
+      //If just the current player has to skip, switch to PLAYER MUST SKIP.
+      set_must_skip_display();
+      g_current_game_state = PLAYER_MUST_SKIP;
     }
   }
   else if(g_current_game_state == PLAYER_MUST_SKIP)
@@ -500,6 +641,7 @@ static void advance_state()
       {
         set_players_turn_display();
         g_current_game_state = BLACK_PLAYER_SELECTING;
+        update_pondering();
       }
       else
       { 
@@ -612,59 +754,186 @@ static void animate_move()
   }
 }
 
-static int get_depth_by_ai_strength(int strength)
+//Drops pondering, and the search it was running.
+static void stop_pondering()
+{
+  if(ponder_timer != NULL)
+  {
+    ai_worker_stop_search();
+    app_timer_cancel(ponder_timer);
+    ponder_timer = NULL;
+  }
+  ponder_state = PONDER_OFF;
+  ponder_move = -1;
+}
+
+//Starts searching the AI's reply to a human move from the current position, as it would search it on its own turn.
+//Leaves ponder_move at -1 if the AI would have no reply, or the book has it.
+static void start_ponder_search(int move)
+{
+  Position pos = g_position;
+  MoveUndo undo;
+  uint64_t replies = 0;
+  make_move(&pos, move, &undo);
+  if(get_move_status(&pos, &replies) != MOVES_AVAILABLE)
+  {
+    ponder_replies[move] = PASS_MOVE;
+    return;
+  }
+  //The book answers without a search.
+  int book_reply = 0;
+  if(book_get_move(&pos, &book_reply))
+  {
+    ponder_replies[move] = book_reply;
+    return;
+  }
+  ponder_move = move;
+  srand(time(NULL));
+  ai_worker_start_search(&pos, get_move_budget_ms(ai_strength, pos.empties), get_move_selectivity(ai_strength));
+  if(ponder_timer == NULL)
+  {
+    ponder_timer = app_timer_register(AI_SLICE_DELAY, async_ponder, NULL);
+  }
+}
+
+//Ponders the highlighted move if it hasn't been, or failing that the first move that hasn't.
+static void start_next_ponder_search()
+{
+  ponder_move = -1;
+  for(int i = -1; i < g_moves.count && ponder_move < 0; i++)
+  {
+    int move = (i < 0) ? get_current_selectable_index() : g_moves.moves[i].index;
+    if(ponder_replies[move] == PONDER_UNSEARCHED)
+    {
+      start_ponder_search(move);
+    }
+  }
+}
+
+//One time slice of pondering, like async_ai_move.
+static void async_ponder()
+{
+  ponder_timer = NULL;
+  if(ponder_state == PONDER_OFF || ponder_move < 0)
+  {
+    return;
+  }
+  if(!ai_worker_continue_search())
+  {
+    ponder_timer = app_timer_register(AI_SLICE_DELAY, async_ponder, NULL);
+    return;
+  }
+  ponder_replies[ponder_move] = ai_worker_get_best_move();
+  if(ponder_state == PONDER_CHOOSING)
+  {
+    start_next_ponder_search();
+  }
+}
+
+//Keeps the pondering in step with the game.  Call it whenever the game state or the highlighted move changes.
+static void update_pondering()
+{
+  if(g_player_count != 1 || g_current_game_state != BLACK_PLAYER_SELECTING || g_moves.count == 0)
+  {
+    //Once the human has moved, that move's search is the AI's, and make_ai_move takes it over.
+    if(ponder_state != PONDER_PLAYED)
+    {
+      stop_pondering();
+    }
+    return;
+  }
+  if(ponder_state != PONDER_CHOOSING)
+  {
+    stop_pondering();
+    ponder_state = PONDER_CHOOSING;
+    memset(ponder_replies, PONDER_UNSEARCHED, sizeof(ponder_replies));
+  }
+  //Whatever is highlighted is the likeliest move.  A search for another one is dropped for it.
+  int move = get_current_selectable_index();
+  if(ponder_move < 0 || (move != ponder_move && ponder_replies[move] == PONDER_UNSEARCHED))
+  {
+    start_next_ponder_search();
+  }
+}
+
+//The human played move, leaving the current position.  Keeps only what was pondered for that move.
+static void ponder_move_played(int move)
 {
-  switch(strength)
+  if(ponder_state != PONDER_CHOOSING)
+  {
+    return;
+  }
+  if(ponder_replies[move] == PONDER_UNSEARCHED && move != ponder_move)
   {
-    case 0:
-      return 1;
-      break;
-    case 1:
-      return 2;
-      break;
-    case 2 :
-      return 3;
-      break;
-    case 3:
-      return 4;
-      break;
-    default:
-      return 2;
+    stop_pondering();
+    return;
   }
+  if(move != ponder_move && ponder_timer != NULL)
+  {
+    ai_worker_stop_search();
+    app_timer_cancel(ponder_timer);
+    ponder_timer = NULL;
+  }
+  ponder_state = PONDER_PLAYED;
+  ponder_move = move;
+  ponder_hash = g_position.hash;
+}
+
+//The AI's reply to the human's last move, if pondering has found it already.  -1 otherwise.
+static int get_ponder_reply()
+{
+  if(ponder_state != PONDER_PLAYED || ponder_replies[ponder_move] < 0)
+  {
+    return -1;
+  }
+  return ponder_replies[ponder_move];
 }
 
 static void async_ai_move()
 {
   if(g_current_game_state == AI_THINKING)
   {
+    //Book moves are played straight away, without searching.
+    int index_to_select = ai_book_move;
+    if(index_to_select < 0 && get_ponder_reply() >= 0)
+    {
+      index_to_select = get_ponder_reply();
+    }
+    else if(index_to_select < 0)
+    {
+      if(!ai_worker_continue_search())
+      {
+        //Hand control back to the event loop between slices, so the display and buttons stay responsive.
+        ai_timer = app_timer_register(AI_SLICE_DELAY, async_ai_move, NULL);
+        return;
+      }
+      index_to_select = ai_worker_get_best_move();
+#if AI_STATS && !AI_WORKER
+      //The worker logs its own.
+      const SearchStats *stats = ai_get_search_stats();
+      snprintf(g_stats_text, sizeof(g_stats_text), "d%d %luk nodes %lums %lu%%tt", stats->depth,
+               (unsigned long)(stats->nodes / 1000), (unsigned long)stats->elapsed_ms,
+               (unsigned long)((stats->tt_hits * 100) / max(stats->tt_probes, (uint32_t)1)));
+#endif
+    }
+    stop_pondering();
     memcpy(g_old_board, g_board, sizeof(char[BOARD_WIDTH*BOARD_HEIGHT]));
     int local_x = 0;
     int local_y = 0;
-    int index_to_select;
-    int empty_squares = (BOARD_WIDTH*BOARD_HEIGHT) - (g_white_score + g_black_score);
-    int depth = get_depth_by_ai_strength(ai_strength);
-    if(empty_squares <= END_GAME_DEPTH_OVERRIDE)
-    {
-      depth = END_GAME_DEPTH_OVERRIDE;
-    }
-    min_max_evaluator(g_board, depth, g_current_player, ALPHA_MIN, BETA_MAX, &index_to_select);
-    //reverse_index(g_selectable_array[rand()%g_selectable_count], &local_x, &local_y);          
 
     reverse_index(index_to_select, &local_x, &local_y);
     //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d selected index %d,%d (option %d) with score: %d",g_current_player, local_x,local_y, index_to_select, new_score);
-    for(int i = 0; i < g_selectable_count; i++)
+    for(int i = 0; i < g_moves.count; i++)
     {
-      int t_x = 0;
-      int t_y = 0;
-      reverse_index(g_selectable_array[i], &t_x, &t_y);
-      //APP_LOG(APP_LOG_LEVEL_DEBUG, "Player %d other option %d,%d (option %d)",g_current_player, t_x,t_y, i);
+      if(g_moves.moves[i].index == index_to_select)
+      {
+        commit_move(g_board, &g_moves.moves[i], g_current_player);
+      }
     }
-    commit_selection(g_board, local_x, local_y, g_current_player);
     anim_center_x = local_x;
     anim_center_y = local_y;
     g_current_player = toggle_player(g_current_player);
-    set_board_selectables_and_score(g_board, &g_black_score, &g_white_score, g_current_player);
-    generate_selectables_array();
+    update_moves_and_score();
     update_score_display();
     advance_state();
   }
@@ -673,37 +942,71 @@ static void async_ai_move()
   ai_thinking = false;
 }
 
-//This should be asynchronous, but let's see how ambitious we get with it.
+//Runs the search one time slice per timer callback, so the app keeps handling input while the AI thinks.
 static void make_ai_move()
 {
+  if(ai_thinking)
+  {
+    //A search is already scheduled for an older position.  Drop it.
+    ai_worker_stop_search();
+    app_timer_cancel(ai_timer);
+  }
   ai_thinking = true;
   srand(time(NULL));
+  //The book is checked before any search starts, so a book move doesn't leave one running.
+  ai_book_move = -1;
+  int book_move = 0;
+  if(book_get_move(&g_position, &book_move))
+  {
+    ai_book_move = book_move;
+    stop_pondering();
+  }
+  else if(ponder_state == PONDER_PLAYED && ponder_hash == g_position.hash)
+  {
+    //Pondering got here first.  Carry on with its search, which has a head start on the clock, or play its reply.
+    if(ponder_timer != NULL)
+    {
+      app_timer_cancel(ponder_timer);
+      ponder_timer = NULL;
+    }
+  }
+  else
+  {
+    stop_pondering();
+    ai_worker_start_search(&g_position, get_move_budget_ms(ai_strength, g_position.empties), get_move_selectivity(ai_strength));
+  }
   ai_timer = app_timer_register(30, async_ai_move, NULL);
 }
 
 
 static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
-  text_layer_set_text(text_layer, "");
+  if(g_current_game_state == AI_THINKING)
+  {
+    //Move now: the AI plays the best move it has found so far.
+    ai_worker_stop_search();
+    return;
+  }
+  set_text_box("");
   if(g_current_game_state == WHITE_PLAYER_SELECTING || g_current_game_state == BLACK_PLAYER_SELECTING)
   {
     memcpy(g_old_board, g_board, sizeof(char[BOARD_WIDTH*BOARD_HEIGHT]));
     int local_x = 0;
     int local_y = 0;
-    reverse_index(get_current_selectable_index(), &local_x, &local_y);
-    commit_selection(g_board, local_x, local_y, g_current_player);
+    int played = get_current_selectable_index();
+    reverse_index(played, &local_x, &local_y);
+    commit_move(g_board, &g_moves.moves[g_selected_square], g_current_player);
     anim_center_x = local_x;
     anim_center_y = local_y;
     g_current_player = toggle_player(g_current_player);
-    set_board_selectables_and_score(g_board, &g_black_score, &g_white_score, g_current_player);
-    generate_selectables_array();
+    update_moves_and_score();
+    ponder_move_played(played);
     update_score_display();
     advance_state();
   }
   else if(g_current_game_state == PLAYER_MUST_SKIP || g_current_game_state == GAME_OVER)
   {
     g_current_player = toggle_player(g_current_player);
-    set_board_selectables_and_score(g_board, &g_black_score, &g_white_score, g_current_player);
-    generate_selectables_array();
+    update_moves_and_score();
     advance_state();
   }
   else if(SPECIAL_SCREENSHOT_MODE && g_current_game_state == ANIMATION_PLAYING)
@@ -715,11 +1018,13 @@ static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
 
 static void up_click_handler(ClickRecognizerRef recognizer, void *context) {
   dec_selectable_index();
+  update_pondering();
   layer_mark_dirty(s_canvas_layer);
 }
 
 static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
   inc_selectable_index();
+  update_pondering();
   layer_mark_dirty(s_canvas_layer);
 }
 
@@ -773,6 +1078,8 @@ static void window_load(Window *window) {
 
   //Update scores
   //reset_game();
+  g_shown_black_score = -1;
+  g_shown_white_score = -1;
   update_score_display();
 
   // Set the update_proc
@@ -785,6 +1092,12 @@ static void window_load(Window *window) {
 #endif
 }
 
+//Whatever was on top of the window drew over the canvas.
+static void window_appear(Window *window) {
+  g_redraw_board = true;
+  layer_mark_dirty(s_canvas_layer);
+}
+
 static void window_unload(Window *window) {
   text_layer_destroy(text_layer);
   layer_destroy(s_canvas_layer);
@@ -898,6 +1211,9 @@ static void settings_window_unload(Window *window) {
 static void ai_settings_set(int new_ai_strength)
 {
   ai_strength = new_ai_strength;
+  //Searches pondered at the old strength would play at it.
+  stop_pondering();
+  update_pondering();
   //Return to game
   window_stack_pop(false);
   window_stack_push(window, true);
@@ -1035,7 +1351,7 @@ static bool validate_deserialization()
 {
   for(int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
   {
-    if(g_board[i] != BLACK && g_board[i] != WHITE && g_board[i] != EMPTY && g_board[i] != SELECTABLE)
+    if(g_board[i] != BLACK && g_board[i] != WHITE && g_board[i] != EMPTY)
     {
       return false;
     }
@@ -1066,9 +1382,7 @@ static bool validate_deserialization()
 static void restore_game_state()
 {
   //Generate the scores and selectable positions
-  set_board_selectables_and_score(g_board, &g_black_score, &g_white_score, g_current_player);
-  generate_selectables_array();
-  g_selected_square = 0;
+  update_moves_and_score();
   //Update the score UI
   update_score_display();
   //Check game state.  Update banner UI
@@ -1100,6 +1414,8 @@ static void restore_game_state()
     set_game_over_display();
   }
 
+  update_pondering();
+
   //Reset Settings Options
   set_settings_menu_ai_item();
   set_settings_menu_pc_item();
@@ -1113,6 +1429,14 @@ static void deserialize_game_state()
     //Restore serializable values, if present
     //Check bounds for appropriateness.
     persist_read_data(BOARD_KEY, g_board, BOARD_WIDTH * BOARD_HEIGHT);
+    for(int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++)
+    {
+      //Older versions saved the selectable markers on the board.  The board only holds discs now.
+      if(g_board[i] == SELECTABLE)
+      {
+        g_board[i] = EMPTY;
+      }
+    }
     persist_read_data(CURRENT_GAME_STATE_KEY, &g_current_game_state, 1);
     g_player_count = persist_read_int(PLAYER_COUNT_KEY);
     g_current_player = persist_read_int(CURRENT_PLAYER_KEY);
@@ -1141,6 +1465,11 @@ static void deserialize_game_state()
 static void init(void) {
   const bool animated = true;
 
+  init_zobrist_keys();
+  book_init();
+  eval_init();
+  ai_worker_init();
+
   //ai settings window
   ai_settings_window = window_create();
   window_set_click_config_provider(ai_settings_window, ai_settings_click_config_provider);
@@ -1168,12 +1497,12 @@ static void init(void) {
 
   //game window
   window = window_create();
-  #ifdef PBL_COLOR
-    window_set_background_color(window, (GColor8){ .argb = 0b11001100 });
-  #endif
+  //The canvas draws the background, so that it can leave what it drew last alone.
+  window_set_background_color(window, GColorClear);
   window_set_click_config_provider(window, click_config_provider);
   window_set_window_handlers(window, (WindowHandlers) {
     .load = window_load,
+    .appear = window_appear,
     .unload = window_unload,
   });
   window_stack_push(window, animated);
@@ -1183,6 +1512,7 @@ static void init(void) {
 
 static void deinit(void) {
   serialize_game_state();
+  ai_worker_deinit();
   window_destroy(window);
   window_destroy(settings_window);
   window_destroy(ai_settings_window);
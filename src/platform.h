@@ -0,0 +1,42 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// The engine (everything except pebble_reversi.c) also builds into desktop tools, with REVERSI_HOST defined.
+// Engine sources include this instead of pebble.h, so those tools don't need the Pebble SDK.
+#if defined(REVERSI_HOST)
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define APP_LOG_LEVEL_ERROR 1
+#define APP_LOG_LEVEL_WARNING 50
+#define APP_LOG_LEVEL_INFO 100
+#define APP_LOG_LEVEL_DEBUG 200
+#define APP_LOG(level, fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+
+// The SDK's message between an app and its background worker, for the host stand-in of the worker (see ai_worker.h).
+typedef struct {
+  uint16_t data0;
+  uint16_t data1;
+  uint16_t data2;
+} AppWorkerMessage;
+#elif defined(REVERSI_WORKER)
+// The background worker's build of the engine (see ai_worker.h).  Workers get a smaller SDK than apps.
+#include <pebble_worker.h>
+#else
+#include <pebble.h>
+#endif
+
+// The search keeps its state in module statics.  On the host several searches can run at once, one per thread
+// (see smp.h), so that state is per thread there.
+#if defined(REVERSI_HOST)
+#define SEARCH_LOCAL __thread
+#else
+#define SEARCH_LOCAL
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+//Multi-ProbCut predictions, written by tools/probcut_fitter from 300 positions per phase.
+//Rerun it rather than editing this file.
+#include "platform.h"
+#include "util.h"
+#include "game.h"
+#include "eval.h"
+#include "probcut.h"
+
+//{shallow depth, slope, offset, sigma} for depths 3 to 10.
+const ProbCut PROBCUT_TABLE[EVAL_PHASES][PROBCUT_DEPTHS] = {
+  {{1, 963, 5, 12}, {2, 1019, -2, 11}, {1, 1033, 10, 14}, {2, 1098, -7, 14}, {3, 1134, 12, 14}, {4, 1115, -13, 14}, {3, 1160, 21, 14}, {4, 1152, -22, 18}},
+  {{1, 1054, 9, 18}, {2, 1048, -3, 16}, {1, 1068, 12, 20}, {2, 1062, -8, 19}, {3, 1075, 8, 17}, {4, 1060, -11, 17}, {3, 1121, 13, 22}, {4, 1113, -15, 21}},
+  {{1, 1056, 9, 29}, {2, 1041, -2, 25}, {1, 1072, 13, 38}, {2, 1070, -1, 34}, {3, 1072, 9, 30}, {4, 1088, 2, 30}, {3, 1135, 10, 35}, {4, 1135, 1, 38}},
+  {{1, 1054, 9, 37}, {2, 1088, 4, 31}, {1, 1071, 12, 45}, {2, 1121, 5, 40}, {3, 1098, 6, 35}, {4, 1074, 3, 34}, {3, 1139, 4, 45}, {4, 1138, 7, 41}},
+  {{1, 1067, 5, 45}, {2, 1060, 6, 36}, {1, 1103, 7, 58}, {2, 1111, 14, 52}, {3, 1112, 1, 51}, {4, 1113, 10, 43}, {3, 1126, -2, 57}, {4, 1131, 14, 52}},
+  {{1, 1027, 5, 42}, {2, 1038, 0, 41}, {1, 1033, 1, 56}, {2, 1039, 1, 57}, {3, 1054, -4, 44}, {4, 1036, -12, 43}, {3, 1037, -18, 55}, {0, 0, 0, 0}}
+};
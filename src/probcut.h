@@ -0,0 +1,25 @@
+#ifndef PROBCUT_H
+#define PROBCUT_H
+
+//Multi-ProbCut.  A shallow search of a node predicts what a deep one would return: deep = slope * shallow + offset,
+//give or take sigma.  When the shallow search says the deep one would fail high (or low) with enough confidence,
+//the node is cut without searching it deeply.  Each depth has its own shallow depth and fit, for each game phase.
+#define PROBCUT_MIN_DEPTH 3
+#define PROBCUT_MAX_DEPTH 10
+#define PROBCUT_DEPTHS (PROBCUT_MAX_DEPTH - PROBCUT_MIN_DEPTH + 1)
+#define PROBCUT_SLOPE_SCALE 1024
+
+//Selectivity levels.  0 searches every node in full; each level above it cuts on less confident predictions.
+#define PROBCUT_LEVELS 5
+
+typedef struct {
+  int8_t shallow_depth; //0 if this depth has no fit.
+  int16_t slope; //In 1/PROBCUT_SLOPE_SCALE.
+  int16_t offset; //In evaluation units, like the scores.
+  int16_t sigma;
+} ProbCut;
+
+//Fitted offline by tools/probcut_fitter, which writes probcut.c.
+extern const ProbCut PROBCUT_TABLE[EVAL_PHASES][PROBCUT_DEPTHS];
+
+#endif
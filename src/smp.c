@@ -0,0 +1,79 @@
+#include "platform.h"
+#if defined(REVERSI_HOST)
+#include <pthread.h>
+#include "util.h"
+#include "game.h"
+#include "ai.h"
+#include "smp.h"
+
+typedef struct {
+  const Position *pos;
+  int selectivity;
+  int depth_step;
+  int depth_limit;
+  int features;
+  const bool *stop;
+  uint32_t nodes;
+  pthread_t thread;
+} Helper;
+
+static Helper s_helpers[SMP_MAX_THREADS];
+
+static void *run_helper(void *argument)
+{
+  Helper *helper = argument;
+  ai_start_helper_search(helper->pos, helper->selectivity, helper->depth_step, helper->depth_limit, helper->features,
+                         helper->stop);
+  while(!ai_continue_search())
+  {
+  }
+  helper->nodes = ai_get_search_nodes();
+  return NULL;
+}
+
+//Searches pos to depth on the calling thread, with threads - 1 helpers, and returns the calling thread's result.
+//The helpers search with the calling thread's features.
+//Every other helper goes two plies deeper at a time, so the helpers aren't all searching what the first thread is.
+void smp_search(const Position *pos, int depth, int selectivity, int threads, SmpResult *result)
+{
+  bool stop = false;
+  threads = min(max(threads, 1), SMP_MAX_THREADS);
+  ai_set_depth_limit(depth);
+  //Starting the first search bumps the table's generation and loads the evaluation tables before any helper runs.
+  ai_start_search(pos, 0, selectivity);
+  for(int i = 1; i < threads; i++)
+  {
+    Helper *helper = &s_helpers[i];
+    helper->pos = pos;
+    helper->selectivity = selectivity;
+    helper->depth_step = 1 + (i & 1);
+    helper->depth_limit = depth;
+    helper->features = ai_get_features();
+    helper->stop = &stop;
+    helper->nodes = 0;
+    if(pthread_create(&helper->thread, NULL, run_helper, helper) != 0)
+    {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "smp_search: can't start helper %d, searching with %d threads", i, i);
+      threads = i;
+      break;
+    }
+  }
+  while(!ai_continue_search())
+  {
+  }
+  __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+  result->move = ai_get_best_move();
+  result->score = ai_get_search_score();
+  result->depth = ai_get_search_depth();
+  result->threads = threads;
+  result->nodes[0] = ai_get_search_nodes();
+  result->total_nodes = result->nodes[0];
+  for(int i = 1; i < threads; i++)
+  {
+    pthread_join(s_helpers[i].thread, NULL);
+    result->nodes[i] = s_helpers[i].nodes;
+    result->total_nodes += s_helpers[i].nodes;
+  }
+  ai_set_depth_limit(0);
+}
+#endif
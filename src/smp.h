@@ -0,0 +1,20 @@
+#ifndef SMP_H
+#define SMP_H
+
+//Host only: Lazy SMP.  Several threads search the same position at once, sharing the transposition table and nothing
+//else.  The first thread's search is the one that counts.  The helpers race it at staggered depths and leave results
+//in the table that save it work.  With one thread it's exactly the single threaded search.
+#define SMP_MAX_THREADS 64
+
+typedef struct {
+  int move;
+  int score; //For the side to move.
+  int depth;
+  int threads;
+  uint32_t nodes[SMP_MAX_THREADS]; //Searched by each thread, the first thread's first.
+  uint64_t total_nodes;
+} SmpResult;
+
+void smp_search(const Position *pos, int depth, int selectivity, int threads, SmpResult *result);
+
+#endif
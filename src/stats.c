@@ -0,0 +1,30 @@
+#include "platform.h"
+#include "util.h"
+#include "stats.h"
+#if AI_STATS
+
+uint32_t stats_get_nodes_per_second(const SearchStats *stats)
+{
+  return (uint32_t)(((uint64_t)stats->nodes * 1000) / max(stats->elapsed_ms, (uint32_t)1));
+}
+
+//One line per search: JSON on the host, for scripts to pick up, and something shorter to read in the watch's log.
+void stats_log(const SearchStats *stats)
+{
+#if defined(REVERSI_HOST)
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "{\"depth\": %d, \"nodes\": %lu, \"evals\": %lu, \"cutoffs\": [%lu, %lu, %lu, %lu], "
+          "\"tt_probes\": %lu, \"tt_hits\": %lu, \"max_ply\": %d, \"ms\": %lu, \"nodes_per_second\": %lu}",
+          stats->depth, (unsigned long)stats->nodes, (unsigned long)stats->evals, (unsigned long)stats->cutoffs[0],
+          (unsigned long)stats->cutoffs[1], (unsigned long)stats->cutoffs[2], (unsigned long)stats->cutoffs[3],
+          (unsigned long)stats->tt_probes, (unsigned long)stats->tt_hits, stats->max_ply, (unsigned long)stats->elapsed_ms,
+          (unsigned long)stats_get_nodes_per_second(stats));
+#else
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "search: depth %d, %lu nodes, %lu evals, cutoffs %lu/%lu/%lu/%lu, tt %lu of %lu, ply %d, %lu ms, %lu n/s",
+          stats->depth, (unsigned long)stats->nodes, (unsigned long)stats->evals, (unsigned long)stats->cutoffs[0],
+          (unsigned long)stats->cutoffs[1], (unsigned long)stats->cutoffs[2], (unsigned long)stats->cutoffs[3],
+          (unsigned long)stats->tt_hits, (unsigned long)stats->tt_probes, stats->max_ply, (unsigned long)stats->elapsed_ms,
+          (unsigned long)stats_get_nodes_per_second(stats));
+#endif
+}
+
+#endif
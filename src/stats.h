@@ -0,0 +1,34 @@
+#ifndef STATS_H
+#define STATS_H
+
+//Search statistics, counted per search when AI_STATS is 1 (see util.h).  With it 0 there's no SearchStats at all,
+//and the STATS_ macros compile to nothing, so the search costs exactly what it did without them.
+#define STATS_CUTOFF_SLOTS 4 //Beta cutoffs by where the move came in its node's order.  The last slot takes the rest,
+                             //and stats_log prints all four.
+
+#if AI_STATS
+typedef struct {
+  uint32_t nodes;
+  uint32_t evals; //Heuristic leaf evaluations, and exact solves of the last few empties.
+  uint32_t cutoffs[STATS_CUTOFF_SLOTS];
+  uint32_t tt_probes;
+  uint32_t tt_hits;
+  uint32_t elapsed_ms;
+  uint8_t depth; //Of the last completed heuristic iteration.
+  uint8_t max_ply; //Deepest frame of the search stack.
+} SearchStats;
+
+#define STATS_COUNT(stats, field) ((stats).field++)
+#define STATS_COUNT_IF(stats, field, condition) ((stats).field += (condition) ? 1 : 0)
+#define STATS_COUNT_CUTOFF(stats, move_number) ((stats).cutoffs[min((move_number), STATS_CUTOFF_SLOTS - 1)]++)
+
+void stats_log(const SearchStats *stats);
+const SearchStats *ai_get_search_stats(); //The last search's, kept by ai.c.
+uint32_t stats_get_nodes_per_second(const SearchStats *stats);
+#else
+#define STATS_COUNT(stats, field) ((void)0)
+#define STATS_COUNT_IF(stats, field, condition) ((void)0)
+#define STATS_COUNT_CUTOFF(stats, move_number) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+#include "platform.h"
+#include "util.h"
+#include "tt.h"
+
+// Fixed-size transposition table.  Each key maps to one bucket of TT_BUCKET_ENTRIES entries.
+// A new position replaces the bucket's least useful entry: anything from an older search first,
+// then the shallowest one, so deep results survive the flood of shallow ones.
+#if defined(REVERSI_HOST)
+// On the host several search threads share the table without locks (see smp.h).  A slot keeps its entry as two words,
+// the key XORed with the rest, so one torn by two threads writing at once no longer matches its key and reads as a miss.
+typedef struct {
+  uint64_t check;
+  uint64_t data;
+} TTSlot;
+#else
+typedef TTEntry TTSlot;
+#endif
+
+typedef struct {
+  TTSlot entries[TT_BUCKET_ENTRIES];
+}
+#if defined(REVERSI_HOST)
+__attribute__((aligned(64)))
+#endif
+TTBucket;
+
+#define TT_BUCKET_COUNT (TT_SIZE_BYTES / sizeof(TTBucket))
+
+static TTBucket s_tt[TT_BUCKET_COUNT];
+static uint8_t s_generation = 0;
+
+#if defined(REVERSI_HOST)
+static void read_slot(const TTSlot *slot, TTEntry *entry)
+{
+  uint64_t data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+  entry->key = __atomic_load_n(&slot->check, __ATOMIC_RELAXED) ^ data;
+  entry->score = (int16_t)(data & 0xffff);
+  entry->depth = (int8_t)((data >> 16) & 0xff);
+  entry->bound = (uint8_t)((data >> 24) & 0xff);
+  entry->move = (int8_t)((data >> 32) & 0xff);
+  entry->generation = (uint8_t)((data >> 40) & 0xff);
+}
+
+static void write_slot(TTSlot *slot, const TTEntry *entry)
+{
+  uint64_t data = (uint64_t)(uint16_t)entry->score | ((uint64_t)(uint8_t)entry->depth << 16) |
+                  ((uint64_t)entry->bound << 24) | ((uint64_t)(uint8_t)entry->move << 32) | ((uint64_t)entry->generation << 40);
+  __atomic_store_n(&slot->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->check, entry->key ^ data, __ATOMIC_RELAXED);
+}
+#else
+static inline void read_slot(const TTSlot *slot, TTEntry *entry)
+{
+  *entry = *slot;
+}
+
+static inline void write_slot(TTSlot *slot, const TTEntry *entry)
+{
+  *slot = *entry;
+}
+#endif
+
+static TTBucket* get_bucket(uint64_t key)
+{
+  // The low bits pick the bucket.  The full key is kept in the entry to reject collisions.
+  return &s_tt[key % TT_BUCKET_COUNT];
+}
+
+void tt_clear()
+{
+  memset(s_tt, 0, sizeof(s_tt));
+  s_generation = 0;
+}
+
+// Marks everything stored so far as stale, so it is replaced first.
+void tt_new_search()
+{
+  s_generation++;
+}
+
+// Copies the entry for key into *entry.  Returns false if the table doesn't have it.
+bool tt_probe(uint64_t key, TTEntry *entry)
+{
+  TTBucket *bucket = get_bucket(key);
+  for(int i = 0; i < TT_BUCKET_ENTRIES; i++)
+  {
+    read_slot(&bucket->entries[i], entry);
+    if(entry->key == key && entry->depth > 0)
+    {
+      if(entry->generation != s_generation)
+      {
+        entry->generation = s_generation;
+        write_slot(&bucket->entries[i], entry);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void tt_store(uint64_t key, int depth, int bound, int score, int move)
+{
+  TTBucket *bucket = get_bucket(key);
+  int victim = 0;
+  TTEntry victim_entry;
+  read_slot(&bucket->entries[0], &victim_entry);
+  for(int i = 0; i < TT_BUCKET_ENTRIES; i++)
+  {
+    TTEntry entry;
+    read_slot(&bucket->entries[i], &entry);
+    if(entry.key == key)
+    {
+      victim = i;
+      if(move == TT_NO_MOVE)
+      {
+        move = entry.move; //Keep the old best move rather than forgetting it.
+      }
+      break;
+    }
+    bool entry_stale = entry.generation != s_generation;
+    bool victim_stale = victim_entry.generation != s_generation;
+    if((entry_stale && !victim_stale) || (entry_stale == victim_stale && entry.depth < victim_entry.depth))
+    {
+      victim = i;
+      victim_entry = entry;
+    }
+  }
+  TTEntry stored = {key, score, depth, bound, move, s_generation};
+  write_slot(&bucket->entries[victim], &stored);
+}
@@ -0,0 +1,26 @@
+#ifndef TT_H
+#define TT_H
+
+//Bound types
+#define TT_BOUND_EXACT 0
+#define TT_BOUND_LOWER 1 //The real score is at least entry score.
+#define TT_BOUND_UPPER 2 //The real score is at most entry score.
+
+#define TT_NO_MOVE -1
+
+//16 bytes.  Scores are stored as the search returned them.
+typedef struct {
+  uint64_t key;
+  int16_t score;
+  int8_t depth;
+  uint8_t bound;
+  int8_t move;
+  uint8_t generation;
+} TTEntry;
+
+void tt_clear();
+void tt_new_search();
+bool tt_probe(uint64_t key, TTEntry *entry);
+void tt_store(uint64_t key, int depth, int bound, int score, int move);
+
+#endif
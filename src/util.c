@@ -1,5 +1,5 @@
 
-#include <pebble.h>
+#include "platform.h"
 #include "util.h"
 
 //Some utility functions
@@ -7,4 +7,19 @@
 bool flip_coin()
 {
   return ( (rand() % 2) == 1);
-}
\ No newline at end of file
+}
+
+//Milliseconds since an arbitrary starting point.  Only differences are meaningful.
+uint32_t get_time_ms()
+{
+#if defined(REVERSI_HOST)
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#else
+  time_t seconds;
+  uint16_t milliseconds;
+  time_ms(&seconds, &milliseconds);
+  return (uint32_t)(seconds * 1000 + milliseconds);
+#endif
+}
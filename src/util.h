@@ -5,7 +5,7 @@
 #define BLACK 'B' 
 #define WHITE 'W' 
 #define EMPTY 'E'
-#define SELECTABLE 'S'
+#define SELECTABLE 'S' // Only found in boards saved by older versions.  Legal moves live in a MoveList now.
 #define ANIMATING 'A'
 
 //States  
@@ -28,17 +28,67 @@
 #define BOARD_WIDTH 8
 #define BOARD_HEIGHT 8
 
-// Safeguard against OOMing.  200 * 64 = 13kb.
-#define MAX_AI_BOARDS 200
+// Host (desktop) builds of the engine define REVERSI_HOST.  Everything else is a watch build, and the background
+// worker's build of it (see ai_worker.h) defines REVERSI_WORKER as well.
+
+// Search in the background worker instead of between the app's redraws.  wscript defines it to 1, and builds the
+// worker, when REVERSI_AI_WORKER=1 is in the environment.
+#ifndef AI_WORKER
+#define AI_WORKER 0
+#endif
+
+// The AI's search arena: everything it keeps per ply, as one SearchFrame of about 140 bytes each, statically allocated.
+// The arena bounds how deep the search goes, and where it's full the search scores positions where they stand.
+// Define it on the command line to try another size.
+#if defined(SEARCH_ARENA_BYTES)
+#elif defined(REVERSI_HOST)
+#define SEARCH_ARENA_BYTES (16*1024)
+#elif defined(PBL_PLATFORM_APLITE) || defined(REVERSI_WORKER)
+#define SEARCH_ARENA_BYTES (3*1024)
+#else
+#define SEARCH_ARENA_BYTES (8*1024)
+#endif
+
+// From this many empty squares on, the AI solves the game exactly instead of searching heuristically.
+#if defined(REVERSI_HOST)
+#define ENDGAME_SOLVE_EMPTIES 20
+#else
+#define ENDGAME_SOLVE_EMPTIES 14
+#endif
+
+// Transposition table budget.  Statically allocated, so it has to fit next to everything else on each watch.
+// A background worker only gets 10.5KB on any watch, so it takes Aplite's sizes for this and the arena.
+#if defined(REVERSI_HOST)
+#define TT_SIZE_BYTES (16*1024*1024)
+#define TT_BUCKET_ENTRIES 4 // 4 * 16 bytes = one 64 byte cache line
+#elif defined(PBL_PLATFORM_APLITE) || defined(REVERSI_WORKER)
+#define TT_SIZE_BYTES (2*1024)
+#define TT_BUCKET_ENTRIES 2
+#else
+#define TT_SIZE_BYTES (8*1024)
+#define TT_BUCKET_ENTRIES 2
+#endif
 
-// Note, alpha-beta pruning deactivated at the moment because it didn't seem to be playing optimally
-// and the Pebble logging code was making debuggging it challenging.
-#define ALPHA_BETA false
 #define ALPHA_MIN -1001 //One worse than white winning
 #define BETA_MAX 1001 // One greater than black winning
 
-//When we get to the endgame, use exhaustive search.
-#define END_GAME_DEPTH_OVERRIDE 7 // Exhaustively search for a win past this number of empty squares
+//Search statistics (see stats.h): nodes, evaluations, cutoffs and table hits, logged once per search and shown over
+//the board.  Build with AI_STATS defined to 1 to collect them.
+#ifndef AI_STATS
+#define AI_STATS 0
+#endif
+
+//AI time budget per move, by difficulty.  The search deepens until the budget runs out.
+#define AI_BUDGET_EASY_MS 50
+#define AI_BUDGET_NORMAL_MS 250
+#define AI_BUDGET_HARD_MS 1000
+#define AI_BUDGET_BRUTAL_MS 3000
+
+//ProbCut selectivity by difficulty (see probcut.h).  Higher levels search deeper but miss more.
+#define AI_SELECTIVITY_EASY 4
+#define AI_SELECTIVITY_NORMAL 3
+#define AI_SELECTIVITY_HARD 3
+#define AI_SELECTIVITY_BRUTAL 3
 
 //Strings
 	//Settings Window
@@ -100,5 +150,6 @@
 //Utility functions
 
 bool flip_coin();
+uint32_t get_time_ms();
 
 #endif
@@ -0,0 +1,762 @@
+// Offline opening book builder.  Grows a tree of positions from the start by drop-out expansion,
+// scores its leaves with the app's own search and writes the book resource the watch reads.
+//
+// Every node is a position keyed by its canonical hash, so transpositions and symmetric twins share one node.
+// A leaf's value is a fixed-depth search; an expanded node's value is the negamax over its children.
+// Each round expands the leaves whose lines cost the least to reach: every move along the way adds how much
+// worse it is than the best move there, plus a flat cost per ply.  The searches run in parallel in forked
+// worker processes, one per core.  Each search empties the transposition table first, so its score depends on
+// nothing the worker searched before.  There's one table per process, so threads would empty it under each other.
+//
+// The tree is checkpointed after every round, so a long build can be stopped and resumed with the same command.
+//
+//   make -C tools book_builder
+//   tools/book_builder -d 12 -n 20000 -c book.ckpt -o resources/opening_book.bin
+#include "platform.h"
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include "util.h"
+#include "game.h"
+#include "tt.h"
+#include "ai.h"
+#include "eval.h"
+#include "book.h"
+
+#define CHECKPOINT_MAGIC "reversi-book-checkpoint"
+#define CHECKPOINT_VERSION 1
+#define MAX_JOBS 256
+#define MAX_BOOK_ENTRIES 65535 //The header's entry count is a uint16.
+#define MAX_BOOK_WEIGHT 255
+#define NO_PRIORITY INT32_MAX
+#define ROUND_EXPANSIONS 16 //Leaves expanded per round.  Not tied to -j, so every machine builds the same book.
+
+typedef struct {
+  uint64_t hash; //Canonical, see book_get_canonical_hash.
+  uint64_t discs[2]; //The position as it was first reached.  Any symmetric twin would do.
+  int8_t player;
+  bool expanded;
+  int16_t leaf_value; //Search score for the side to move.
+  int16_t value; //Negamax over the expanded tree.
+  int32_t priority; //Drop-out cost of the cheapest line from the start.
+  uint32_t stamp;
+} BookNode;
+
+typedef struct {
+  uint64_t discs[2];
+  int32_t player;
+  int32_t depth;
+} SearchRequest;
+
+typedef struct {
+  pid_t pid;
+  int request_fd;
+  int reply_fd;
+  int node; //Index of the node being searched, or -1 when idle.
+} Worker;
+
+typedef struct {
+  uint32_t key;
+  uint8_t move;
+  uint8_t weight;
+} BookEntry;
+
+static BookNode *s_nodes;
+static int s_node_count;
+static int s_node_capacity;
+static int32_t *s_index; //Open addressing table of node indexes, -1 for a free slot.
+static int s_index_size;
+static uint32_t s_stamp;
+
+static Worker s_workers[MAX_JOBS];
+static int s_job_count;
+
+static int s_depth = 10;
+static int s_max_ply = 20;
+static int s_ply_cost = 2 * EVAL_SCALE;
+static int s_margin = 0;
+static int s_target_expansions = 2000;
+static const char *s_checkpoint_path;
+static const char *s_output_path;
+static const char *s_weights_path;
+static uint8_t *s_weights_data;
+
+static void die(const char *message)
+{
+  fprintf(stderr, "book_builder: %s (%s)\n", message, strerror(errno));
+  exit(1);
+}
+
+static void *checked_realloc(void *memory, size_t size)
+{
+  memory = realloc(memory, size);
+  if(memory == NULL)
+  {
+    die("out of memory");
+  }
+  return memory;
+}
+
+static void load_weights(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    die("can't read weights");
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  s_weights_data = checked_realloc(NULL, size);
+  if(fread(s_weights_data, 1, size, file) != (size_t)size)
+  {
+    die("can't read weights");
+  }
+  fclose(file);
+  eval_set_data(s_weights_data, size);
+}
+
+static void node_to_position(const BookNode *node, Position *pos)
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+  {
+    board[i] = (node->discs[0] & (1ULL << i)) ? BLACK : (node->discs[1] & (1ULL << i)) ? WHITE : EMPTY;
+  }
+  board_to_position(board, node->player, pos);
+}
+
+static int get_ply(const BookNode *node)
+{
+  return bitboard_count(node->discs[0] | node->discs[1]) - 4;
+}
+
+// Node lookup by canonical hash.
+
+static int find_slot(uint64_t hash)
+{
+  int mask = s_index_size - 1;
+  int slot = (int)(hash & mask);
+  while(s_index[slot] >= 0 && s_nodes[s_index[slot]].hash != hash)
+  {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static void grow_index()
+{
+  free(s_index);
+  s_index_size = max(s_index_size * 2, 1024);
+  s_index = checked_realloc(NULL, s_index_size * sizeof(int32_t));
+  memset(s_index, 0xff, s_index_size * sizeof(int32_t));
+  for(int i = 0; i < s_node_count; i++)
+  {
+    s_index[find_slot(s_nodes[i].hash)] = i;
+  }
+}
+
+static int find_node(uint64_t hash)
+{
+  return (s_index_size == 0) ? -1 : s_index[find_slot(hash)];
+}
+
+// Returns the node for pos, adding an unsearched leaf if it's new.  *added says which.
+static int add_node(const Position *pos, bool *added)
+{
+  int symmetry = 0;
+  uint64_t hash = book_get_canonical_hash(pos, &symmetry);
+  int existing = find_node(hash);
+  *added = (existing < 0);
+  if(existing >= 0)
+  {
+    return existing;
+  }
+  if(s_node_count == s_node_capacity)
+  {
+    s_node_capacity = max(s_node_capacity * 2, 1024);
+    s_nodes = checked_realloc(s_nodes, s_node_capacity * sizeof(BookNode));
+  }
+  if((s_node_count + 1) * 2 > s_index_size)
+  {
+    grow_index();
+  }
+  BookNode *node = &s_nodes[s_node_count];
+  memset(node, 0, sizeof(BookNode));
+  node->hash = hash;
+  node->discs[0] = pos->discs[0];
+  node->discs[1] = pos->discs[1];
+  node->player = pos->player;
+  node->priority = NO_PRIORITY;
+  s_index[find_slot(hash)] = s_node_count;
+  return s_node_count++;
+}
+
+// Fills moves and children with the node's moves (just PASS_MOVE if it must pass) and the nodes they lead to.
+// Children that aren't in the tree yet are added and listed in new_leaves, if that's given.
+static int get_children(int index, int *moves, int *children, int *new_leaves, int *new_leaf_count)
+{
+  Position pos;
+  node_to_position(&s_nodes[index], &pos);
+  uint64_t legal = 0;
+  int status = get_move_status(&pos, &legal);
+  int count = 0;
+  if(status == MOVES_GAME_OVER)
+  {
+    return 0;
+  }
+  if(status == MOVES_MUST_PASS)
+  {
+    legal = 0;
+    moves[count++] = PASS_MOVE;
+  }
+  while(legal)
+  {
+    moves[count++] = __builtin_ctzll(legal);
+    legal &= legal - 1;
+  }
+  for(int i = 0; i < count; i++)
+  {
+    MoveUndo undo;
+    bool added = false;
+    make_move(&pos, moves[i], &undo);
+    if(new_leaves != NULL)
+    {
+      children[i] = add_node(&pos, &added);
+      if(added)
+      {
+        new_leaves[(*new_leaf_count)++] = children[i];
+      }
+    }
+    else
+    {
+      int symmetry = 0;
+      children[i] = find_node(book_get_canonical_hash(&pos, &symmetry));
+    }
+    unmake_move(&pos, &undo);
+  }
+  return count;
+}
+
+// Leaf searches, farmed out to the worker processes.
+
+static bool read_all(int fd, void *buffer, size_t length)
+{
+  uint8_t *bytes = buffer;
+  while(length > 0)
+  {
+    ssize_t got = read(fd, bytes, length);
+    if(got <= 0)
+    {
+      if(got < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    bytes += got;
+    length -= got;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const void *buffer, size_t length)
+{
+  const uint8_t *bytes = buffer;
+  while(length > 0)
+  {
+    ssize_t put = write(fd, bytes, length);
+    if(put <= 0)
+    {
+      if(put < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    bytes += put;
+    length -= put;
+  }
+  return true;
+}
+
+// Scores each requested position for its side to move until the builder closes the pipe.
+static void run_worker(int request_fd, int reply_fd)
+{
+  SearchRequest request;
+  while(read_all(request_fd, &request, sizeof(request)))
+  {
+    BookNode node;
+    Position pos;
+    char board[BOARD_WIDTH*BOARD_HEIGHT];
+    int selection = 0;
+    node.discs[0] = request.discs[0];
+    node.discs[1] = request.discs[1];
+    node.player = request.player;
+    node_to_position(&node, &pos);
+    for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+    {
+      board[i] = (pos.discs[0] & (1ULL << i)) ? BLACK : (pos.discs[1] & (1ULL << i)) ? WHITE : EMPTY;
+    }
+    //A cold table makes every score depend on the position alone, not on which worker searched it,
+    //so a resumed build comes out the same as an uninterrupted one.
+    tt_clear();
+    int32_t score = min_max_evaluator(board, request.depth - 1, request.player, ALPHA_MIN, BETA_MAX, &selection);
+    if(request.player == 1)
+    {
+      score = -score;
+    }
+    if(!write_all(reply_fd, &score, sizeof(score)))
+    {
+      break;
+    }
+  }
+  _exit(0);
+}
+
+static void start_workers()
+{
+  for(int i = 0; i < s_job_count; i++)
+  {
+    int requests[2];
+    int replies[2];
+    if(pipe(requests) != 0 || pipe(replies) != 0)
+    {
+      die("can't create worker pipes");
+    }
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+      die("can't start worker");
+    }
+    if(pid == 0)
+    {
+      close(requests[1]);
+      close(replies[0]);
+      for(int j = 0; j < i; j++)
+      {
+        close(s_workers[j].request_fd);
+        close(s_workers[j].reply_fd);
+      }
+      run_worker(requests[0], replies[1]);
+    }
+    close(requests[0]);
+    close(replies[1]);
+    s_workers[i].pid = pid;
+    s_workers[i].request_fd = requests[1];
+    s_workers[i].reply_fd = replies[0];
+    s_workers[i].node = -1;
+  }
+}
+
+static void stop_workers()
+{
+  for(int i = 0; i < s_job_count; i++)
+  {
+    close(s_workers[i].request_fd);
+    close(s_workers[i].reply_fd);
+    waitpid(s_workers[i].pid, NULL, 0);
+  }
+}
+
+static void search_leaves(const int *leaves, int count)
+{
+  int next = 0;
+  int done = 0;
+  while(done < count)
+  {
+    for(int i = 0; i < s_job_count && next < count; i++)
+    {
+      if(s_workers[i].node < 0)
+      {
+        const BookNode *node = &s_nodes[leaves[next]];
+        SearchRequest request = {{node->discs[0], node->discs[1]}, node->player, s_depth};
+        if(!write_all(s_workers[i].request_fd, &request, sizeof(request)))
+        {
+          die("worker stopped");
+        }
+        s_workers[i].node = leaves[next++];
+      }
+    }
+    fd_set ready;
+    int highest = -1;
+    FD_ZERO(&ready);
+    for(int i = 0; i < s_job_count; i++)
+    {
+      if(s_workers[i].node >= 0)
+      {
+        FD_SET(s_workers[i].reply_fd, &ready);
+        highest = max(highest, s_workers[i].reply_fd);
+      }
+    }
+    if(select(highest + 1, &ready, NULL, NULL, NULL) < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      die("select failed");
+    }
+    for(int i = 0; i < s_job_count; i++)
+    {
+      if(s_workers[i].node >= 0 && FD_ISSET(s_workers[i].reply_fd, &ready))
+      {
+        int32_t score = 0;
+        if(!read_all(s_workers[i].reply_fd, &score, sizeof(score)))
+        {
+          die("worker stopped");
+        }
+        s_nodes[s_workers[i].node].leaf_value = score;
+        s_workers[i].node = -1;
+        done++;
+      }
+    }
+  }
+}
+
+// Minimax propagation and drop-out priorities over the tree.
+
+static int get_value(int index)
+{
+  BookNode *node = &s_nodes[index];
+  if(node->stamp == s_stamp)
+  {
+    return node->value;
+  }
+  int value = node->leaf_value;
+  if(node->expanded)
+  {
+    int moves[BOARD_WIDTH*BOARD_HEIGHT];
+    int children[BOARD_WIDTH*BOARD_HEIGHT];
+    int count = get_children(index, moves, children, NULL, NULL);
+    if(count > 0)
+    {
+      value = ALPHA_MIN;
+      for(int i = 0; i < count; i++)
+      {
+        value = max(value, -get_value(children[i]));
+      }
+    }
+  }
+  node->value = value;
+  node->stamp = s_stamp;
+  return value;
+}
+
+static void spread_priority(int index, int32_t priority)
+{
+  BookNode *node = &s_nodes[index];
+  if(priority >= node->priority)
+  {
+    return;
+  }
+  node->priority = priority;
+  if(!node->expanded)
+  {
+    return;
+  }
+  int moves[BOARD_WIDTH*BOARD_HEIGHT];
+  int children[BOARD_WIDTH*BOARD_HEIGHT];
+  int count = get_children(index, moves, children, NULL, NULL);
+  for(int i = 0; i < count; i++)
+  {
+    int loss = s_nodes[index].value + s_nodes[children[i]].value; //Best value minus this move's value.
+    spread_priority(children[i], priority + loss + s_ply_cost);
+  }
+}
+
+static void update_tree()
+{
+  s_stamp++;
+  get_value(0);
+  for(int i = 0; i < s_node_count; i++)
+  {
+    s_nodes[i].priority = NO_PRIORITY;
+  }
+  spread_priority(0, 0);
+}
+
+static int compare_priority(const void *a, const void *b)
+{
+  int32_t pa = s_nodes[*(const int *)a].priority;
+  int32_t pb = s_nodes[*(const int *)b].priority;
+  return (pa < pb) ? -1 : (pa > pb) ? 1 : (*(const int *)a - *(const int *)b);
+}
+
+// Expands up to limit of the cheapest leaves.  Returns how many it expanded; zero means the book is complete.
+static int expand_round(int limit)
+{
+  int *candidates = checked_realloc(NULL, s_node_count * sizeof(int));
+  int candidate_count = 0;
+  for(int i = 0; i < s_node_count; i++)
+  {
+    const BookNode *node = &s_nodes[i];
+    if(!node->expanded && node->priority != NO_PRIORITY && get_ply(node) < s_max_ply)
+    {
+      candidates[candidate_count++] = i;
+    }
+  }
+  qsort(candidates, candidate_count, sizeof(int), compare_priority);
+  int *new_leaves = NULL;
+  int new_leaf_count = 0;
+  int expanded = 0;
+  for(int i = 0; i < candidate_count && expanded < limit; i++)
+  {
+    int moves[BOARD_WIDTH*BOARD_HEIGHT];
+    int children[BOARD_WIDTH*BOARD_HEIGHT];
+    new_leaves = checked_realloc(new_leaves, (new_leaf_count + BOARD_WIDTH*BOARD_HEIGHT) * sizeof(int));
+    if(get_children(candidates[i], moves, children, new_leaves, &new_leaf_count) > 0)
+    {
+      s_nodes[candidates[i]].expanded = true;
+      expanded++;
+    }
+  }
+  search_leaves(new_leaves, new_leaf_count);
+  free(new_leaves);
+  free(candidates);
+  return expanded;
+}
+
+// Checkpoints: a header line with the search settings, then one line per node.
+
+static void save_checkpoint()
+{
+  char temp_path[4096];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", s_checkpoint_path);
+  FILE *file = fopen(temp_path, "w");
+  if(file == NULL)
+  {
+    die("can't write checkpoint");
+  }
+  fprintf(file, "%s %d %d %d\n", CHECKPOINT_MAGIC, CHECKPOINT_VERSION, s_depth, s_node_count);
+  for(int i = 0; i < s_node_count; i++)
+  {
+    const BookNode *node = &s_nodes[i];
+    fprintf(file, "%016llx %016llx %d %d %d\n", (unsigned long long)node->discs[0], (unsigned long long)node->discs[1],
+            node->player, node->leaf_value, node->expanded ? 1 : 0);
+  }
+  if(fclose(file) != 0 || rename(temp_path, s_checkpoint_path) != 0)
+  {
+    die("can't write checkpoint");
+  }
+}
+
+static bool load_checkpoint()
+{
+  FILE *file = fopen(s_checkpoint_path, "r");
+  if(file == NULL)
+  {
+    return false;
+  }
+  char magic[64];
+  int version = 0;
+  int depth = 0;
+  int count = 0;
+  if(fscanf(file, "%63s %d %d %d", magic, &version, &depth, &count) != 4 || strcmp(magic, CHECKPOINT_MAGIC) != 0 ||
+     version != CHECKPOINT_VERSION)
+  {
+    fprintf(stderr, "book_builder: %s is not a checkpoint\n", s_checkpoint_path);
+    exit(1);
+  }
+  if(depth != s_depth)
+  {
+    fprintf(stderr, "book_builder: checkpoint was searched to depth %d, not %d\n", depth, s_depth);
+    exit(1);
+  }
+  for(int i = 0; i < count; i++)
+  {
+    unsigned long long discs[2];
+    int player = 0;
+    int value = 0;
+    int expanded = 0;
+    if(fscanf(file, "%llx %llx %d %d %d", &discs[0], &discs[1], &player, &value, &expanded) != 5)
+    {
+      fprintf(stderr, "book_builder: %s is truncated\n", s_checkpoint_path);
+      exit(1);
+    }
+    BookNode leaf;
+    Position pos;
+    bool added = false;
+    leaf.discs[0] = discs[0];
+    leaf.discs[1] = discs[1];
+    leaf.player = player;
+    node_to_position(&leaf, &pos);
+    int index = add_node(&pos, &added);
+    s_nodes[index].leaf_value = value;
+    s_nodes[index].expanded = (expanded != 0);
+  }
+  fclose(file);
+  return true;
+}
+
+// Book output.  Every expanded node where the side to move has a choice gets its best moves,
+// and those within the margin of the best, weighted by how close they come.
+
+static int compare_entries(const void *a, const void *b)
+{
+  const BookEntry *ea = a;
+  const BookEntry *eb = b;
+  if(ea->key != eb->key)
+  {
+    return (ea->key < eb->key) ? -1 : 1;
+  }
+  return ea->move - eb->move;
+}
+
+static void write_book()
+{
+  BookEntry *entries = NULL;
+  int entry_count = 0;
+  int position_count = 0;
+  for(int i = 0; i < s_node_count && entry_count < MAX_BOOK_ENTRIES; i++)
+  {
+    if(!s_nodes[i].expanded)
+    {
+      continue;
+    }
+    int moves[BOARD_WIDTH*BOARD_HEIGHT];
+    int children[BOARD_WIDTH*BOARD_HEIGHT];
+    int count = get_children(i, moves, children, NULL, NULL);
+    if(count == 0 || moves[0] == PASS_MOVE)
+    {
+      continue;
+    }
+    Position pos;
+    int symmetry = 0;
+    node_to_position(&s_nodes[i], &pos);
+    uint32_t key = book_get_key(book_get_canonical_hash(&pos, &symmetry));
+    entries = checked_realloc(entries, (entry_count + count) * sizeof(BookEntry));
+    position_count++;
+    for(int j = 0; j < count && entry_count < MAX_BOOK_ENTRIES; j++)
+    {
+      int loss = s_nodes[i].value + s_nodes[children[j]].value;
+      if(loss > s_margin)
+      {
+        continue;
+      }
+      entries[entry_count].key = key;
+      entries[entry_count].move = book_transform_index(moves[j], symmetry);
+      entries[entry_count].weight = MAX_BOOK_WEIGHT * (s_margin + 1 - loss) / (s_margin + 1);
+      entry_count++;
+    }
+  }
+  qsort(entries, entry_count, sizeof(BookEntry), compare_entries);
+  FILE *file = fopen(s_output_path, "wb");
+  if(file == NULL)
+  {
+    die("can't write book");
+  }
+  uint8_t header[BOOK_HEADER_SIZE] = {'R', 'B', 'K', BOOK_VERSION, entry_count & 0xff, entry_count >> 8};
+  fwrite(header, 1, BOOK_HEADER_SIZE, file);
+  for(int i = 0; i < entry_count; i++)
+  {
+    uint32_t key = entries[i].key;
+    uint8_t bytes[BOOK_ENTRY_SIZE] = {key & 0xff, (key >> 8) & 0xff, (key >> 16) & 0xff, key >> 24, entries[i].move, entries[i].weight};
+    fwrite(bytes, 1, BOOK_ENTRY_SIZE, file);
+  }
+  if(fclose(file) != 0)
+  {
+    die("can't write book");
+  }
+  fprintf(stderr, "wrote %s: %d positions, %d entries, %d bytes\n", s_output_path, position_count, entry_count,
+          BOOK_HEADER_SIZE + entry_count * BOOK_ENTRY_SIZE);
+  free(entries);
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: book_builder [options] -o book.bin\n"
+          "  -d depth     leaf search depth in plies (default %d)\n"
+          "  -n count     expanded positions to stop at (default %d)\n"
+          "  -p ply       deepest ply to expand (default %d)\n"
+          "  -w file      evaluation weights for the searches (default: disc counting)\n"
+          "  -k cost      drop-out cost per ply, against the score loss of a worse move (default %d)\n"
+          "  -m margin    book moves within this much of the best one, too (default %d)\n"
+          "  -j jobs      worker processes (default: one per core)\n"
+          "  -c file      checkpoint file, resumed from if it exists\n"
+          "Scores are in 1/%d discs.\n",
+          s_depth, s_target_expansions, s_max_ply, s_ply_cost, s_margin, EVAL_SCALE);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int option;
+  s_job_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  while((option = getopt(argc, argv, "d:n:p:w:k:m:j:c:o:")) != -1)
+  {
+    switch(option)
+    {
+      case 'd': s_depth = atoi(optarg); break;
+      case 'n': s_target_expansions = atoi(optarg); break;
+      case 'p': s_max_ply = atoi(optarg); break;
+      case 'w': s_weights_path = optarg; break;
+      case 'k': s_ply_cost = atoi(optarg); break;
+      case 'm': s_margin = atoi(optarg); break;
+      case 'j': s_job_count = atoi(optarg); break;
+      case 'c': s_checkpoint_path = optarg; break;
+      case 'o': s_output_path = optarg; break;
+      default: usage();
+    }
+  }
+  if(s_output_path == NULL || s_depth < 1 || s_margin < 0)
+  {
+    usage();
+  }
+  s_job_count = min(max(s_job_count, 1), MAX_JOBS);
+  signal(SIGPIPE, SIG_IGN);
+  init_zobrist_keys();
+  eval_init();
+  if(s_weights_path != NULL)
+  {
+    load_weights(s_weights_path);
+  }
+  start_workers();
+
+  if(s_checkpoint_path == NULL || !load_checkpoint())
+  {
+    char board[BOARD_WIDTH*BOARD_HEIGHT];
+    Position start;
+    bool added = false;
+    memset(board, EMPTY, sizeof(board));
+    board[get_board_index(3, 3)] = WHITE;
+    board[get_board_index(4, 4)] = WHITE;
+    board[get_board_index(4, 3)] = BLACK;
+    board[get_board_index(3, 4)] = BLACK;
+    board_to_position(board, 0, &start);
+    int root = add_node(&start, &added);
+    search_leaves(&root, 1);
+  }
+
+  int expanded = 0;
+  for(int i = 0; i < s_node_count; i++)
+  {
+    expanded += s_nodes[i].expanded ? 1 : 0;
+  }
+  // Each expansion searches all of a leaf's children, which keeps every core busy without straying far from the
+  // cheapest lines.  Rounds are the same size whatever -j is and are never cut short to hit the target exactly,
+  // so neither the core count nor stopping and resuming changes the book.
+  while(expanded < s_target_expansions)
+  {
+    update_tree();
+    int round = expand_round(ROUND_EXPANSIONS);
+    if(round == 0)
+    {
+      break;
+    }
+    expanded += round;
+    if(s_checkpoint_path != NULL)
+    {
+      save_checkpoint();
+    }
+    fprintf(stderr, "expanded %d of %d, %d positions, start value %d\n", expanded, s_target_expansions, s_node_count,
+            s_nodes[0].value);
+  }
+  update_tree();
+  stop_workers();
+  write_book();
+  return 0;
+}
@@ -0,0 +1,420 @@
+// Fits the pattern evaluation weights (see src/eval.h) and writes the weights resource.
+//
+// Training positions come from self-play: a few random opening moves, then fixed-depth searches with the current
+// weights.  Once few enough squares are left the game is solved exactly, and every position before that is labelled
+// with the exact result from there; the positions after it are each solved on their own.  Each phase's tables are
+// then fitted to the labels by least squares.  Samples are kept in a file, so rounds of games can be added over several
+// runs, each searching with the weights the last round produced.
+//
+//   make -C tools eval_trainer
+//   tools/eval_trainer -g 20000 -s samples.bin -o resources/eval_weights.bin
+//   tools/eval_trainer -g 20000 -s samples.bin -w resources/eval_weights.bin -o resources/eval_weights.bin
+#include "platform.h"
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "util.h"
+#include "game.h"
+#include "ai.h"
+#include "endgame.h"
+#include "eval.h"
+
+#define SAMPLE_SIZE 17 //uint64 own discs, uint64 opponent's discs, int8 final margin for the side to move.
+#define MAX_GAME_POSITIONS 128
+#define WEIGHT_LIMIT 32767
+
+typedef struct {
+  uint64_t own;
+  uint64_t opp;
+  int8_t score;
+} Sample;
+
+typedef struct {
+  uint16_t features[EVAL_FEATURES];
+  float target;
+} TrainingRow;
+
+static int s_game_count = 0;
+static int s_depth = 4;
+static int s_random_plies = 12;
+static int s_exact_empties = 14;
+static int s_epochs = 200;
+static const char *s_sample_path;
+static const char *s_weights_path;
+static const char *s_output_path;
+static uint8_t *s_weights_data;
+
+static void die(const char *message)
+{
+  fprintf(stderr, "eval_trainer: %s (%s)\n", message, strerror(errno));
+  exit(1);
+}
+
+static void *checked_realloc(void *memory, size_t size)
+{
+  memory = realloc(memory, size);
+  if(memory == NULL)
+  {
+    die("out of memory");
+  }
+  return memory;
+}
+
+static void load_weights(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    die("can't read weights");
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  s_weights_data = checked_realloc(NULL, size);
+  if(fread(s_weights_data, 1, size, file) != (size_t)size)
+  {
+    die("can't read weights");
+  }
+  fclose(file);
+  eval_set_data(s_weights_data, size);
+}
+
+static void get_start_position(Position *pos)
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  memset(board, EMPTY, sizeof(board));
+  board[get_board_index(3, 3)] = WHITE;
+  board[get_board_index(4, 4)] = WHITE;
+  board[get_board_index(4, 3)] = BLACK;
+  board[get_board_index(3, 4)] = BLACK;
+  board_to_position(board, 0, pos);
+}
+
+static int pick_random_move(uint64_t moves)
+{
+  int skip = rand() % bitboard_count(moves);
+  while(skip-- > 0)
+  {
+    moves &= moves - 1;
+  }
+  return __builtin_ctzll(moves);
+}
+
+static int pick_search_move(const Position *pos)
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  int selection = 0;
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+  {
+    board[i] = (pos->discs[0] & (1ULL << i)) ? BLACK : (pos->discs[1] & (1ULL << i)) ? WHITE : EMPTY;
+  }
+  min_max_evaluator(board, s_depth - 1, pos->player, ALPHA_MIN, BETA_MAX, &selection);
+  return selection;
+}
+
+static int solve(const Position *pos)
+{
+  uint64_t moves = 0;
+  if(get_move_status(pos, &moves) == MOVES_GAME_OVER)
+  {
+    return endgame_final_score(pos);
+  }
+  return endgame_solve(pos, -ENDGAME_MAX_SCORE - 1, ENDGAME_MAX_SCORE + 1);
+}
+
+static void write_sample(FILE *file, const Position *pos, int score)
+{
+  uint8_t bytes[SAMPLE_SIZE];
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  for(int i = 0; i < 8; i++)
+  {
+    bytes[i] = (own >> (8 * i)) & 0xff;
+    bytes[i + 8] = (opp >> (8 * i)) & 0xff;
+  }
+  bytes[16] = (uint8_t)(int8_t)score;
+  if(fwrite(bytes, 1, SAMPLE_SIZE, file) != SAMPLE_SIZE)
+  {
+    die("can't write samples");
+  }
+}
+
+// Plays one game and writes a labelled sample for each position in it.
+static void play_game(FILE *file)
+{
+  Position history[MAX_GAME_POSITIONS];
+  int history_count = 0;
+  Position pos;
+  MoveUndo undo;
+  uint64_t moves = 0;
+  int random_plies = rand() % (s_random_plies + 1);
+  get_start_position(&pos);
+  for(int ply = 0; pos.empties > s_exact_empties; ply++)
+  {
+    int status = get_move_status(&pos, &moves);
+    if(status == MOVES_GAME_OVER)
+    {
+      break;
+    }
+    history[history_count++] = pos;
+    if(status == MOVES_MUST_PASS)
+    {
+      make_move(&pos, PASS_MOVE, &undo);
+      continue;
+    }
+    make_move(&pos, (ply < random_plies) ? pick_random_move(moves) : pick_search_move(&pos), &undo);
+  }
+  int exact = solve(&pos);
+  for(int i = 0; i < history_count; i++)
+  {
+    write_sample(file, &history[i], (history[i].player == pos.player) ? exact : -exact);
+  }
+  // The rest of the game is cheap to solve position by position.
+  while(true)
+  {
+    int status = get_move_status(&pos, &moves);
+    if(status == MOVES_GAME_OVER)
+    {
+      break;
+    }
+    write_sample(file, &pos, solve(&pos));
+    make_move(&pos, (status == MOVES_MUST_PASS) ? PASS_MOVE : pick_search_move(&pos), &undo);
+  }
+}
+
+static void play_games()
+{
+  FILE *file = fopen(s_sample_path, "ab");
+  if(file == NULL)
+  {
+    die("can't write samples");
+  }
+  uint32_t start_ms = get_time_ms();
+  for(int i = 0; i < s_game_count; i++)
+  {
+    play_game(file);
+    if((i + 1) % 100 == 0 || i + 1 == s_game_count)
+    {
+      fflush(file);
+      fprintf(stderr, "played %d of %d games, %u s\n", i + 1, s_game_count, (unsigned)((get_time_ms() - start_ms) / 1000));
+    }
+  }
+  if(fclose(file) != 0)
+  {
+    die("can't write samples");
+  }
+}
+
+static Sample *read_samples(int *count)
+{
+  FILE *file = fopen(s_sample_path, "rb");
+  if(file == NULL)
+  {
+    die("can't read samples");
+  }
+  Sample *samples = NULL;
+  int capacity = 0;
+  uint8_t bytes[SAMPLE_SIZE];
+  *count = 0;
+  while(fread(bytes, 1, SAMPLE_SIZE, file) == SAMPLE_SIZE)
+  {
+    if(*count == capacity)
+    {
+      capacity = max(capacity * 2, 65536);
+      samples = checked_realloc(samples, capacity * sizeof(Sample));
+    }
+    Sample *sample = &samples[(*count)++];
+    sample->own = 0;
+    sample->opp = 0;
+    for(int i = 0; i < 8; i++)
+    {
+      sample->own |= (uint64_t)bytes[i] << (8 * i);
+      sample->opp |= (uint64_t)bytes[i + 8] << (8 * i);
+    }
+    sample->score = (int8_t)bytes[16];
+  }
+  fclose(file);
+  return samples;
+}
+
+static float get_prediction(const float *weights, const TrainingRow *row)
+{
+  float prediction = 0;
+  for(int f = 0; f < EVAL_FEATURES; f++)
+  {
+    prediction += weights[row->features[f]];
+  }
+  return prediction;
+}
+
+static double get_rms_error(const float *weights, const TrainingRow *rows, int count)
+{
+  double total = 0;
+  for(int i = 0; i < count; i++)
+  {
+    double error = rows[i].target - get_prediction(weights, &rows[i]);
+    total += error * error;
+  }
+  return (count > 0) ? sqrt(total / count) / EVAL_SCALE : 0;
+}
+
+// Least squares by gradient descent.  Each step moves a weight by its average error over the rows that use it,
+// shrunk towards zero for rarely seen configurations, and split between the instances that share each row.
+static void fit_phase(int phase, const TrainingRow *rows, int train_count, int test_count, int16_t *table)
+{
+  const float RARE_DAMPING = 8;
+  float *weights = calloc(EVAL_TABLE_SIZE, sizeof(float));
+  float *gradient = checked_realloc(NULL, EVAL_TABLE_SIZE * sizeof(float));
+  float *uses = calloc(EVAL_TABLE_SIZE, sizeof(float));
+  if(weights == NULL || uses == NULL)
+  {
+    die("out of memory");
+  }
+  for(int i = 0; i < train_count; i++)
+  {
+    for(int f = 0; f < EVAL_FEATURES; f++)
+    {
+      uses[rows[i].features[f]] += 1;
+    }
+  }
+  float step = 1.0f / EVAL_FEATURES;
+  for(int epoch = 0; epoch < s_epochs; epoch++)
+  {
+    memset(gradient, 0, EVAL_TABLE_SIZE * sizeof(float));
+    for(int i = 0; i < train_count; i++)
+    {
+      float error = rows[i].target - get_prediction(weights, &rows[i]);
+      for(int f = 0; f < EVAL_FEATURES; f++)
+      {
+        gradient[rows[i].features[f]] += error;
+      }
+    }
+    for(int w = 0; w < EVAL_TABLE_SIZE; w++)
+    {
+      weights[w] += step * gradient[w] / (uses[w] + RARE_DAMPING);
+    }
+  }
+  for(int w = 0; w < EVAL_TABLE_SIZE; w++)
+  {
+    table[w] = (int16_t)min(max((int)lroundf(weights[w]), -WEIGHT_LIMIT), WEIGHT_LIMIT);
+  }
+  fprintf(stderr, "phase %d: %d samples, rms error %.2f discs (%.2f on held out samples)\n", phase, train_count,
+          get_rms_error(weights, rows, train_count), get_rms_error(weights, rows + train_count, test_count));
+  free(uses);
+  free(gradient);
+  free(weights);
+}
+
+// Fits every phase, holding one sample in ten out to measure the fit on.
+static void train()
+{
+  int sample_count = 0;
+  Sample *samples = read_samples(&sample_count);
+  TrainingRow *rows = checked_realloc(NULL, max(sample_count, 1) * sizeof(TrainingRow));
+  int16_t *tables = checked_realloc(NULL, EVAL_PHASES * EVAL_TABLE_SIZE * sizeof(int16_t));
+  for(int phase = 0; phase < EVAL_PHASES; phase++)
+  {
+    int row_count = 0;
+    int train_count = 0;
+    for(int held_out = 0; held_out < 2; held_out++)
+    {
+      for(int i = 0; i < sample_count; i++)
+      {
+        Position pos;
+        pos.discs[0] = samples[i].own;
+        pos.discs[1] = samples[i].opp;
+        pos.player = 0;
+        int empties = BOARD_WIDTH*BOARD_HEIGHT - bitboard_count(pos.discs[0] | pos.discs[1]);
+        if(eval_get_phase(empties) == phase && (i % 10 == 0) == held_out)
+        {
+          eval_get_features(&pos, rows[row_count].features);
+          rows[row_count].target = samples[i].score * EVAL_SCALE;
+          row_count++;
+        }
+      }
+      if(!held_out)
+      {
+        train_count = row_count;
+      }
+    }
+    fit_phase(phase, rows, train_count, row_count - train_count, tables + phase * EVAL_TABLE_SIZE);
+  }
+  FILE *file = fopen(s_output_path, "wb");
+  if(file == NULL)
+  {
+    die("can't write weights");
+  }
+  uint8_t header[EVAL_HEADER_SIZE] = {'R', 'E', 'V', EVAL_VERSION, EVAL_PHASES};
+  fwrite(header, 1, EVAL_HEADER_SIZE, file);
+  for(int i = 0; i < EVAL_PHASES * EVAL_TABLE_SIZE; i++)
+  {
+    uint8_t bytes[2] = {(uint16_t)tables[i] & 0xff, (uint16_t)tables[i] >> 8};
+    fwrite(bytes, 1, 2, file);
+  }
+  if(fclose(file) != 0)
+  {
+    die("can't write weights");
+  }
+  fprintf(stderr, "wrote %s from %d samples\n", s_output_path, sample_count);
+  free(tables);
+  free(rows);
+  free(samples);
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: eval_trainer [options] -s samples.bin [-o weights.bin]\n"
+          "  -g games     self-play games to add to the sample file first (default %d)\n"
+          "  -w file      weights for the self-play searches (default: disc counting)\n"
+          "  -d depth     self-play search depth in plies (default %d)\n"
+          "  -r plies     up to this many random opening moves per game (default %d)\n"
+          "  -x empties   solve games exactly from this many empty squares (default %d)\n"
+          "  -e epochs    training passes (default %d)\n"
+          "  -S seed      random seed (default: the time)\n"
+          "  -o file      fit the weights to every sample and write them here\n",
+          s_game_count, s_depth, s_random_plies, s_exact_empties, s_epochs);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int option;
+  unsigned seed = (unsigned)time(NULL);
+  while((option = getopt(argc, argv, "g:w:d:r:x:e:S:s:o:")) != -1)
+  {
+    switch(option)
+    {
+      case 'g': s_game_count = atoi(optarg); break;
+      case 'w': s_weights_path = optarg; break;
+      case 'd': s_depth = atoi(optarg); break;
+      case 'r': s_random_plies = atoi(optarg); break;
+      case 'x': s_exact_empties = atoi(optarg); break;
+      case 'e': s_epochs = atoi(optarg); break;
+      case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 's': s_sample_path = optarg; break;
+      case 'o': s_output_path = optarg; break;
+      default: usage();
+    }
+  }
+  if(s_sample_path == NULL || s_depth < 1 || s_random_plies < 0 || s_exact_empties < 1 || (s_game_count <= 0 && s_output_path == NULL))
+  {
+    usage();
+  }
+  srand(seed);
+  init_zobrist_keys();
+  eval_init();
+  if(s_weights_path != NULL)
+  {
+    load_weights(s_weights_path);
+  }
+  if(s_game_count > 0)
+  {
+    play_games();
+  }
+  if(s_output_path != NULL)
+  {
+    train();
+  }
+  return 0;
+}
@@ -0,0 +1,308 @@
+// Fits the Multi-ProbCut predictions (see src/probcut.h) and writes them out as src/probcut.c.
+//
+// Positions come from self-play: a few random opening moves, then shallow searches with the evaluation weights.
+// Each position is searched to every depth up to PROBCUT_MAX_DEPTH, and for each depth and game phase the deep
+// scores are fitted to the scores of its shallow depth by least squares.  Sigma is the spread of what's left over.
+//
+//   make -C tools probcut_fitter
+//   tools/probcut_fitter -w resources/eval_weights.bin -o src/probcut.c
+#include "platform.h"
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "util.h"
+#include "game.h"
+#include "ai.h"
+#include "eval.h"
+#include "probcut.h"
+
+#define GAME_DEPTH 2 //Search depth of the self-play moves, which only need to be plausible.
+#define SAMPLE_INTERVAL 3 //Keep every this many positions of a game, so one game doesn't fill a phase.
+#define MIN_FIT_SAMPLES 30 //Fewer than this and a depth goes without a prediction.
+
+typedef struct {
+  int count;
+  double shallow_sum;
+  double deep_sum;
+  double shallow_squares;
+  double deep_squares;
+  double products;
+} PairSums;
+
+static int s_positions_per_phase = 100;
+static int s_random_plies = 12;
+static const char *s_weights_path;
+static const char *s_output_path;
+static uint8_t *s_weights_data;
+static int s_phase_counts[EVAL_PHASES];
+static PairSums s_sums[EVAL_PHASES][PROBCUT_DEPTHS];
+
+static void die(const char *message)
+{
+  fprintf(stderr, "probcut_fitter: %s (%s)\n", message, strerror(errno));
+  exit(1);
+}
+
+static void load_weights(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    die("can't read weights");
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  s_weights_data = malloc(size);
+  if(s_weights_data == NULL || fread(s_weights_data, 1, size, file) != (size_t)size)
+  {
+    die("can't read weights");
+  }
+  fclose(file);
+  eval_set_data(s_weights_data, size);
+}
+
+// The shallow search that predicts each deep one: about half as deep, and of the same parity, since scores swing
+// between odd and even depths.
+static int get_shallow_depth(int depth)
+{
+  int shallow = depth / 2;
+  if((depth - shallow) & 1)
+  {
+    shallow--;
+  }
+  return max(shallow, 1);
+}
+
+static void get_start_position(Position *pos)
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  memset(board, EMPTY, sizeof(board));
+  board[get_board_index(3, 3)] = WHITE;
+  board[get_board_index(4, 4)] = WHITE;
+  board[get_board_index(4, 3)] = BLACK;
+  board[get_board_index(3, 4)] = BLACK;
+  board_to_position(board, 0, pos);
+}
+
+// Score of a fixed-depth search for the side to move, and its move in *selection.
+static int search(const Position *pos, int depth, int *selection)
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  for(int i = 0; i < BOARD_WIDTH*BOARD_HEIGHT; i++)
+  {
+    board[i] = (pos->discs[0] & (1ULL << i)) ? BLACK : (pos->discs[1] & (1ULL << i)) ? WHITE : EMPTY;
+  }
+  int score = min_max_evaluator(board, depth - 1, pos->player, ALPHA_MIN, BETA_MAX, selection);
+  return (pos->player == 0) ? score : -score;
+}
+
+// Searches pos to every depth, shallowest first as iterative deepening would, and adds each depth's pair of scores.
+static void add_position(const Position *pos)
+{
+  int phase = eval_get_phase(pos->empties);
+  int scores[PROBCUT_MAX_DEPTH + 1];
+  int deepest = min(PROBCUT_MAX_DEPTH, pos->empties);
+  int selection = 0;
+  ai_clear();
+  for(int depth = 1; depth <= deepest; depth++)
+  {
+    scores[depth] = search(pos, depth, &selection);
+  }
+  for(int depth = PROBCUT_MIN_DEPTH; depth <= deepest; depth++)
+  {
+    int shallow = scores[get_shallow_depth(depth)];
+    int deep = scores[depth];
+    //Won and lost games aren't on the heuristic scale.
+    if(abs(shallow) > EVAL_LIMIT || abs(deep) > EVAL_LIMIT)
+    {
+      continue;
+    }
+    PairSums *sums = &s_sums[phase][depth - PROBCUT_MIN_DEPTH];
+    sums->count++;
+    sums->shallow_sum += shallow;
+    sums->deep_sum += deep;
+    sums->shallow_squares += (double)shallow * shallow;
+    sums->deep_squares += (double)deep * deep;
+    sums->products += (double)shallow * deep;
+  }
+  s_phase_counts[phase]++;
+}
+
+static bool phases_full()
+{
+  for(int phase = 0; phase < EVAL_PHASES; phase++)
+  {
+    if(s_phase_counts[phase] < s_positions_per_phase)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Plays games until every phase has its positions.
+static void collect_positions()
+{
+  uint32_t start_ms = get_time_ms();
+  int games = 0;
+  while(!phases_full())
+  {
+    Position pos;
+    MoveUndo undo;
+    uint64_t moves = 0;
+    int random_plies = rand() % (s_random_plies + 1);
+    get_start_position(&pos);
+    for(int ply = 0; true; ply++)
+    {
+      int status = get_move_status(&pos, &moves);
+      if(status == MOVES_GAME_OVER)
+      {
+        break;
+      }
+      if(status == MOVES_MUST_PASS)
+      {
+        make_move(&pos, PASS_MOVE, &undo);
+        continue;
+      }
+      if(ply >= random_plies && (ply - random_plies) % SAMPLE_INTERVAL == 0 &&
+         s_phase_counts[eval_get_phase(pos.empties)] < s_positions_per_phase)
+      {
+        add_position(&pos);
+      }
+      int move = 0;
+      if(ply < random_plies)
+      {
+        int skip = rand() % bitboard_count(moves);
+        while(skip-- > 0)
+        {
+          moves &= moves - 1;
+        }
+        move = __builtin_ctzll(moves);
+      }
+      else
+      {
+        search(&pos, GAME_DEPTH, &move);
+      }
+      make_move(&pos, move, &undo);
+    }
+    games++;
+    if(games % 10 == 0)
+    {
+      fprintf(stderr, "played %d games, %u s, positions per phase:", games, (unsigned)((get_time_ms() - start_ms) / 1000));
+      for(int phase = 0; phase < EVAL_PHASES; phase++)
+      {
+        fprintf(stderr, " %d", s_phase_counts[phase]);
+      }
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
+// Least squares fit of deep = slope * shallow + offset, with sigma the residuals' standard deviation.
+static ProbCut fit(const PairSums *sums, int depth)
+{
+  ProbCut cut = {0, 0, 0, 0};
+  double n = sums->count;
+  double shallow_variance = sums->shallow_squares - sums->shallow_sum * sums->shallow_sum / n;
+  if(sums->count < MIN_FIT_SAMPLES || shallow_variance <= 0)
+  {
+    return cut;
+  }
+  double covariance = sums->products - sums->shallow_sum * sums->deep_sum / n;
+  double slope = covariance / shallow_variance;
+  double offset = (sums->deep_sum - slope * sums->shallow_sum) / n;
+  double residuals = sums->deep_squares - sums->deep_sum * sums->deep_sum / n - slope * covariance;
+  double sigma = sqrt(fmax(residuals, 0) / (n - 2));
+  if(slope <= 0)
+  {
+    return cut;
+  }
+  cut.shallow_depth = get_shallow_depth(depth);
+  cut.slope = (int16_t)lround(slope * PROBCUT_SLOPE_SCALE);
+  cut.offset = (int16_t)lround(offset);
+  cut.sigma = (int16_t)ceil(sigma);
+  return cut;
+}
+
+static void write_table()
+{
+  FILE *file = fopen(s_output_path, "w");
+  if(file == NULL)
+  {
+    die("can't write output");
+  }
+  fprintf(file, "//Multi-ProbCut predictions, written by tools/probcut_fitter from %d positions per phase.\n"
+                "//Rerun it rather than editing this file.\n"
+                "#include \"platform.h\"\n"
+                "#include \"util.h\"\n"
+                "#include \"game.h\"\n"
+                "#include \"eval.h\"\n"
+                "#include \"probcut.h\"\n"
+                "\n"
+                "//{shallow depth, slope, offset, sigma} for depths %d to %d.\n"
+                "const ProbCut PROBCUT_TABLE[EVAL_PHASES][PROBCUT_DEPTHS] = {\n",
+          s_positions_per_phase, PROBCUT_MIN_DEPTH, PROBCUT_MAX_DEPTH);
+  for(int phase = 0; phase < EVAL_PHASES; phase++)
+  {
+    fprintf(file, "  {");
+    for(int depth = PROBCUT_MIN_DEPTH; depth <= PROBCUT_MAX_DEPTH; depth++)
+    {
+      const PairSums *sums = &s_sums[phase][depth - PROBCUT_MIN_DEPTH];
+      ProbCut cut = fit(sums, depth);
+      fprintf(file, "%s{%d, %d, %d, %d}", (depth > PROBCUT_MIN_DEPTH) ? ", " : "", cut.shallow_depth, cut.slope, cut.offset,
+              cut.sigma);
+      fprintf(stderr, "phase %d depth %2d from %d: %4d samples, slope %.3f, offset %4d, sigma %4d (%.1f discs)\n", phase, depth,
+              get_shallow_depth(depth), sums->count, (double)cut.slope / PROBCUT_SLOPE_SCALE, cut.offset, cut.sigma,
+              (double)cut.sigma / EVAL_SCALE);
+    }
+    fprintf(file, "}%s\n", (phase < EVAL_PHASES - 1) ? "," : "");
+  }
+  fprintf(file, "};\n");
+  if(fclose(file) != 0)
+  {
+    die("can't write output");
+  }
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: probcut_fitter [options] -w weights.bin -o probcut.c\n"
+          "  -w file      evaluation weights for the searches\n"
+          "  -o file      C source to write the fitted table to\n"
+          "  -n count     positions per game phase (default %d)\n"
+          "  -r plies     most random opening moves per game (default %d)\n"
+          "  -S seed      random seed (default: the time)\n",
+          s_positions_per_phase, s_random_plies);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int option;
+  unsigned seed = (unsigned)time(NULL);
+  while((option = getopt(argc, argv, "w:o:n:r:S:")) != -1)
+  {
+    switch(option)
+    {
+      case 'w': s_weights_path = optarg; break;
+      case 'o': s_output_path = optarg; break;
+      case 'n': s_positions_per_phase = atoi(optarg); break;
+      case 'r': s_random_plies = atoi(optarg); break;
+      case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      default: usage();
+    }
+  }
+  if(s_weights_path == NULL || s_output_path == NULL || s_positions_per_phase < 1 || s_random_plies < 0)
+  {
+    usage();
+  }
+  srand(seed);
+  init_zobrist_keys();
+  eval_init();
+  load_weights(s_weights_path);
+  collect_positions();
+  write_table();
+  return 0;
+}
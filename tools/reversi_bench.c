@@ -0,0 +1,644 @@
+// Micro-benchmarks for the engine, built from the same sources as the watch app.
+// Each benchmark runs one piece of work over a fixed set of positions from random games and reports its cost per call,
+// so a change to a kernel shows up as a number rather than a feeling.
+//
+//   make -C tools reversi_bench
+//   tools/reversi_bench -w resources/eval_weights.bin            every benchmark
+//   tools/reversi_bench -w resources/eval_weights.bin frontier   just the named ones
+//
+// The perft benchmark counts the leaves of the full game tree to a fixed depth from the start position and a few
+// midgame and endgame positions, checks each count against its known value, and reports leaves per second.
+// It exercises nothing but move generation and make_move/unmake_move, the same calls the search makes.
+//
+// The search benchmarks run fixed-depth iterative deepening searches over midgame positions with some of the
+// search features switched off, and report nodes and time per search against plain alpha-beta.  The smp benchmark
+// runs them with 1, 2, 4, 8 and 16 threads, and reports each count's speedup over one thread.
+//
+// The minimax check searches every position 1 to 4 plies deep, with and without PVS and aspiration windows, and checks
+// each score and move against a plain minimax search of the same tree.  It fails if one differs.
+//
+// The worker benchmark puts the same searches through the background worker's protocol, to its host stand-in, and
+// checks that every move comes back as searching in place found it.  It fails if one doesn't.
+#include "platform.h"
+#include <errno.h>
+#include <unistd.h>
+#include "util.h"
+#include "game.h"
+#include "eval.h"
+#include "ai.h"
+#include "smp.h"
+#include "ai_worker.h"
+
+#define BENCH_POSITIONS 4096
+#define BENCH_TRIALS 5
+#define BENCH_TRIAL_NS 50000000ULL //Each trial repeats the work for at least this long.
+#define BENCH_SEED 0x62656e6368ULL // "bench"
+#define SEARCH_POSITIONS 24
+#define SEARCH_MIN_EMPTIES 24 //Midgame only, so no search turns into an endgame solve.
+#define SEARCH_MAX_EMPTIES 48
+#define DEFAULT_SEARCH_DEPTH 8
+#define SMP_BENCHMARK "smp"
+#define PERFT_BENCHMARK "perft"
+#define WORKER_BENCHMARK "worker"
+#define MINIMAX_CHECK "minimax"
+#define MINIMAX_MAX_DEPTH 4
+#define GAME_WON_SCORE 1000 //As ai.c scores a finished game.
+
+typedef uint64_t (*BenchFunction)(const Position *pos);
+
+typedef struct {
+  const char *name;
+  const char *description;
+  BenchFunction run;
+} Benchmark;
+
+typedef struct {
+  const char *name;
+  const char *description;
+  int features;
+  int selectivity;
+} SearchBenchmark;
+
+//A perft position.  The board is 64 squares in board index order: 'X' black, 'O' white, '-' empty.
+typedef struct {
+  const char *name;
+  const char *board;
+  int player;
+  int depth;
+  uint64_t leaves;
+} PerftPosition;
+
+static Position s_positions[BENCH_POSITIONS];
+static int s_search_depth = DEFAULT_SEARCH_DEPTH;
+static double s_baseline_nodes; //Nodes per search of the first search benchmark run, to compare the others against.
+static uint8_t *s_weights_data;
+
+static uint64_t get_time_ns()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// A private generator, so the positions don't depend on what else calls rand().
+static uint32_t next_random(uint64_t *state)
+{
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (uint32_t)(*state >> 33);
+}
+
+// Random games, keeping every position along the way, so all phases of the game are covered.
+static void make_positions()
+{
+  uint64_t state = BENCH_SEED;
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  memset(board, EMPTY, sizeof(board));
+  board[get_board_index(3, 3)] = WHITE;
+  board[get_board_index(4, 4)] = WHITE;
+  board[get_board_index(4, 3)] = BLACK;
+  board[get_board_index(3, 4)] = BLACK;
+  Position start;
+  board_to_position(board, 0, &start);
+  Position pos = start;
+  for(int i = 0; i < BENCH_POSITIONS; i++)
+  {
+    uint64_t moves = 0;
+    int status = get_move_status(&pos, &moves);
+    if(status == MOVES_GAME_OVER)
+    {
+      pos = start;
+      status = get_move_status(&pos, &moves);
+    }
+    s_positions[i] = pos;
+    MoveUndo undo;
+    int move = PASS_MOVE;
+    if(status == MOVES_AVAILABLE)
+    {
+      for(int skip = next_random(&state) % bitboard_count(moves); skip > 0; skip--)
+      {
+        moves &= moves - 1;
+      }
+      move = __builtin_ctzll(moves);
+    }
+    make_move(&pos, move, &undo);
+  }
+}
+
+// Evaluation terms, both sides each, exactly as the evaluator computes them.
+
+static uint64_t bench_mobility(const Position *pos)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  return bitboard_count(bitboard_get_moves(own, opp)) + bitboard_count(bitboard_get_moves(opp, own));
+}
+
+static uint64_t bench_potential_mobility(const Position *pos)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  return bitboard_count(bitboard_get_potential_moves(own, opp)) + bitboard_count(bitboard_get_potential_moves(opp, own));
+}
+
+static uint64_t bench_frontier(const Position *pos)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  return bitboard_count(bitboard_get_frontier(own, opp)) + bitboard_count(bitboard_get_frontier(opp, own));
+}
+
+static uint64_t bench_edge_stable(const Position *pos)
+{
+  uint64_t own = pos->discs[pos->player];
+  uint64_t opp = pos->discs[toggle_player(pos->player)];
+  return bitboard_count(bitboard_get_edge_stable(own, opp)) + bitboard_count(bitboard_get_edge_stable(opp, own));
+}
+
+static uint64_t bench_features(const Position *pos)
+{
+  uint16_t features[EVAL_FEATURES];
+  eval_get_features(pos, features);
+  return features[0] + features[EVAL_FEATURES - 1];
+}
+
+static uint64_t bench_eval(const Position *pos)
+{
+  return (uint64_t)eval_position(pos);
+}
+
+static const Benchmark BENCHMARKS[] = {
+  {"mobility", "legal moves for both sides", bench_mobility},
+  {"potential_mobility", "empty squares next to each side's discs", bench_potential_mobility},
+  {"frontier", "discs next to an empty square, both sides", bench_frontier},
+  {"edge_stable", "edge-anchored stable discs, both sides", bench_edge_stable},
+  {"features", "every table index the evaluator reads", bench_features},
+  {"eval", "a whole leaf evaluation", bench_eval},
+};
+#define BENCHMARK_COUNT ((int)(sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0])))
+
+// Reports the fastest of several trials, since anything else running on the machine only ever adds time.
+static void run_benchmark(const Benchmark *benchmark)
+{
+  uint64_t checksum = 0;
+  double best = 0;
+  for(int trial = 0; trial < BENCH_TRIALS; trial++)
+  {
+    uint64_t calls = 0;
+    uint64_t start = get_time_ns();
+    uint64_t elapsed = 0;
+    checksum = 0;
+    do
+    {
+      for(int i = 0; i < BENCH_POSITIONS; i++)
+      {
+        checksum += benchmark->run(&s_positions[i]);
+      }
+      calls += BENCH_POSITIONS;
+      elapsed = get_time_ns() - start;
+    } while(elapsed < BENCH_TRIAL_NS);
+    checksum /= calls / BENCH_POSITIONS;
+    if(trial == 0 || (double)elapsed / calls < best)
+    {
+      best = (double)elapsed / calls;
+    }
+  }
+  printf("%-20s %8.1f ns/call  %-45s (checksum %llu)\n", benchmark->name, best, benchmark->description,
+         (unsigned long long)checksum);
+}
+
+// Search benchmarks: the same searches with more of the search's features switched on each time, then ProbCut at
+// each selectivity level, which trades some accuracy for its nodes.
+
+static const SearchBenchmark SEARCH_BENCHMARKS[] = {
+  {"search_alphabeta", "fail-soft alpha-beta", 0, 0},
+  {"search_pvs", "principal variation search", AI_FEATURE_PVS, 0},
+  {"search_aspiration", "PVS with aspiration windows", AI_FEATURE_PVS | AI_FEATURE_ASPIRATION, 0},
+  {"search_probcut1", "all of them, ProbCut selectivity 1", AI_FEATURES_ALL, 1},
+  {"search_probcut2", "all of them, ProbCut selectivity 2", AI_FEATURES_ALL, 2},
+  {"search_probcut3", "all of them, ProbCut selectivity 3", AI_FEATURES_ALL, 3},
+  {"search_probcut4", "all of them, ProbCut selectivity 4", AI_FEATURES_ALL, 4},
+};
+#define SEARCH_BENCHMARK_COUNT ((int)(sizeof(SEARCH_BENCHMARKS) / sizeof(SEARCH_BENCHMARKS[0])))
+
+// Every search starts from a clear table and history and the same random seed, so each benchmark's node count is repeatable.
+static void run_search_benchmark(const SearchBenchmark *benchmark)
+{
+  uint64_t nodes = 0;
+  int searches = 0;
+  int high_water = 0;
+  ai_set_features(benchmark->features);
+  ai_set_depth_limit(s_search_depth);
+  uint64_t start = get_time_ns();
+  for(int i = 0; i < BENCH_POSITIONS && searches < SEARCH_POSITIONS; i += 37)
+  {
+    const Position *pos = &s_positions[i];
+    if(pos->empties < SEARCH_MIN_EMPTIES || pos->empties > SEARCH_MAX_EMPTIES)
+    {
+      continue;
+    }
+    ai_clear();
+    srand((unsigned)BENCH_SEED);
+    eval_set_phase(pos->empties);
+    ai_start_search(pos, 0, benchmark->selectivity);
+    while(!ai_continue_search())
+    {
+    }
+    nodes += ai_get_search_nodes();
+    high_water = max(high_water, ai_get_stack_high_water());
+    searches++;
+  }
+  uint64_t elapsed = get_time_ns() - start;
+  ai_set_features(AI_FEATURES_ALL);
+  ai_set_depth_limit(0);
+  double nodes_per_search = (double)nodes / searches;
+  if(s_baseline_nodes == 0)
+  {
+    s_baseline_nodes = nodes_per_search;
+  }
+  printf("%-20s %8.2f ms/search %10.0f nodes  %+6.1f%%  %-36s (depth %d, %d positions, frames to %d of %d)\n",
+         benchmark->name, elapsed / 1e6 / searches, nodes_per_search, 100.0 * (nodes_per_search / s_baseline_nodes - 1),
+         benchmark->description, s_search_depth, searches, high_water + 1, ai_get_stack_capacity());
+}
+
+// A pass is a ply of its own, and a finished game is a leaf however shallow, as in the published start position counts.
+static const PerftPosition PERFT_POSITIONS[] = {
+  {"start", "---------------------------OX------XO---------------------------", 0, 9, 3005288},
+  {"opening", "---XO------XXXX--XXXO-O----OOX----OXOXX-----O-------------------", 0, 7, 33437076},
+  {"midgame", "-O-X---O-XOXO--O---O-OXO-XXXOXO--O-XXOOOO-OOOX-O--O---X---------", 0, 7, 31986517},
+  {"late midgame", "--OOXXX-O-OOOXXX-OOOXOX-XOOXXXXXO-OXOO--OOXOOXO-OOO-XX-------X--", 0, 7, 8784577},
+  {"endgame", "---X-XXOXXXXXXOO-X-X-OXOOXXXOXX-OXOOXXXXOXOXOXXXOXXOXXXX-XXX--O-", 0, 14, 201381},
+};
+#define PERFT_POSITION_COUNT ((int)(sizeof(PERFT_POSITIONS) / sizeof(PERFT_POSITIONS[0])))
+
+static uint64_t perft(Position *pos, int depth)
+{
+  if(depth == 0)
+  {
+    return 1;
+  }
+  uint64_t moves = 0;
+  int status = get_move_status(pos, &moves);
+  if(status == MOVES_GAME_OVER)
+  {
+    return 1;
+  }
+  MoveUndo undo;
+  uint64_t leaves = 0;
+  if(status == MOVES_MUST_PASS)
+  {
+    make_move(pos, PASS_MOVE, &undo);
+    leaves = perft(pos, depth - 1);
+    unmake_move(pos, &undo);
+    return leaves;
+  }
+  while(moves != 0)
+  {
+    make_move(pos, __builtin_ctzll(moves), &undo);
+    leaves += perft(pos, depth - 1);
+    unmake_move(pos, &undo);
+    moves &= moves - 1;
+  }
+  return leaves;
+}
+
+// Returns false if any count is wrong, which means move generation is broken and no other number can be trusted.
+static bool run_perft_benchmark()
+{
+  bool correct = true;
+  uint64_t total_leaves = 0;
+  uint64_t total_ns = 0;
+  for(int i = 0; i < PERFT_POSITION_COUNT; i++)
+  {
+    const PerftPosition *perft_pos = &PERFT_POSITIONS[i];
+    char board[BOARD_WIDTH*BOARD_HEIGHT];
+    for(int j = 0; j < BOARD_WIDTH*BOARD_HEIGHT; j++)
+    {
+      board[j] = (perft_pos->board[j] == 'X') ? BLACK : (perft_pos->board[j] == 'O') ? WHITE : EMPTY;
+    }
+    Position pos;
+    board_to_position(board, perft_pos->player, &pos);
+    uint64_t start = get_time_ns();
+    uint64_t leaves = perft(&pos, perft_pos->depth);
+    uint64_t elapsed = get_time_ns() - start;
+    total_leaves += leaves;
+    total_ns += elapsed;
+    printf("perft %-14s %8.1f Mnodes/s  depth %2d  %10llu leaves%s\n", perft_pos->name, leaves * 1e3 / elapsed,
+           perft_pos->depth, (unsigned long long)leaves, (leaves == perft_pos->leaves) ? "" : "  WRONG");
+    if(leaves != perft_pos->leaves)
+    {
+      printf("  expected %llu\n", (unsigned long long)perft_pos->leaves);
+      correct = false;
+    }
+  }
+  printf("perft %-14s %8.1f Mnodes/s  %.2f s\n", "total", total_leaves * 1e3 / total_ns, total_ns / 1e9);
+  return correct;
+}
+
+// Lazy SMP: the same searches on more threads each time.  Each is timed to the same depth, so the speedup is wall time.
+// It needs a core per thread to mean anything; the first thread's nodes show how much the helpers save it regardless.
+static void run_smp_benchmark()
+{
+  static const int THREAD_COUNTS[] = {1, 2, 4, 8, 16};
+  double single_ms = 0;
+  for(int t = 0; t < (int)(sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0])); t++)
+  {
+    uint64_t nodes = 0;
+    uint64_t first_nodes = 0;
+    int searches = 0;
+    int same_moves = 0;
+    static int s_single_moves[SEARCH_POSITIONS];
+    uint64_t start = get_time_ns();
+    for(int i = 0; i < BENCH_POSITIONS && searches < SEARCH_POSITIONS; i += 37)
+    {
+      const Position *pos = &s_positions[i];
+      if(pos->empties < SEARCH_MIN_EMPTIES || pos->empties > SEARCH_MAX_EMPTIES)
+      {
+        continue;
+      }
+      SmpResult result;
+      ai_clear();
+      srand((unsigned)BENCH_SEED);
+      smp_search(pos, s_search_depth, 0, THREAD_COUNTS[t], &result);
+      nodes += result.total_nodes;
+      first_nodes += result.nodes[0];
+      if(t == 0)
+      {
+        s_single_moves[searches] = result.move;
+      }
+      same_moves += (result.move == s_single_moves[searches]);
+      searches++;
+    }
+    double ms = (get_time_ns() - start) / 1e6 / searches;
+    if(t == 0)
+    {
+      single_ms = ms;
+    }
+    printf("smp %2d threads        %8.2f ms/search %10.0f nodes %9.0f in the first thread  %5.2fx speedup  "
+           "%d of %d moves as with 1 thread (depth %d)\n", THREAD_COUNTS[t], ms, (double)nodes / searches,
+           (double)first_nodes / searches, single_ms / ms, same_moves, searches, s_search_depth);
+  }
+}
+
+// Plain minimax over the same tree the search sees, for the side to move.  A pass uses up a ply, a finished game scores
+// as won, lost or drawn, and depth 0 is evaluated as it stands, finished or not, as the search does.
+static int minimax(Position *pos, int depth)
+{
+  if(depth == 0)
+  {
+    return eval_position(pos);
+  }
+  uint64_t moves = 0;
+  int status = get_move_status(pos, &moves);
+  if(status == MOVES_GAME_OVER)
+  {
+    int margin = pos->disc_count[pos->player] - pos->disc_count[toggle_player(pos->player)];
+    return (margin > 0) ? GAME_WON_SCORE : (margin < 0) ? -GAME_WON_SCORE : 0;
+  }
+  MoveUndo undo;
+  if(status == MOVES_MUST_PASS)
+  {
+    make_move(pos, PASS_MOVE, &undo);
+    int score = -minimax(pos, depth - 1);
+    unmake_move(pos, &undo);
+    return score;
+  }
+  int best = -GAME_WON_SCORE - 1;
+  for(; moves != 0; moves &= moves - 1)
+  {
+    make_move(pos, __builtin_ctzll(moves), &undo);
+    best = max(best, -minimax(pos, depth - 1));
+    unmake_move(pos, &undo);
+  }
+  return best;
+}
+
+// Returns false if any search's score differs from minimax's, or its move scores worse under minimax than the best.
+// Pruning, null windows and aspiration windows may only save work, never change the answer.
+static bool run_minimax_check()
+{
+  static const int FEATURES[] = {0, AI_FEATURES_ALL};
+  int searches = 0;
+  int mismatches = 0;
+  uint64_t start = get_time_ns();
+  for(int f = 0; f < (int)(sizeof(FEATURES) / sizeof(FEATURES[0])); f++)
+  {
+    ai_set_features(FEATURES[f]);
+    for(int i = 0; i < BENCH_POSITIONS; i++)
+    {
+      Position pos = s_positions[i];
+      uint64_t moves = 0;
+      int status = get_move_status(&pos, &moves);
+      //The search only looks one ply deep when it has no choice to make.
+      int depth = (bitboard_count(moves) <= 1) ? 1 : min(1 + i % MINIMAX_MAX_DEPTH, pos.empties);
+      ai_set_depth_limit(depth);
+      ai_clear();
+      ai_start_search(&pos, 0, 0);
+      while(!ai_continue_search())
+      {
+      }
+      //The search has picked the evaluation tables for this position, so minimax scores with the same ones.
+      int expected = minimax(&pos, depth);
+      int score = ai_get_search_score();
+      int move_score = expected;
+      int move = ai_get_best_move();
+      if(status == MOVES_AVAILABLE)
+      {
+        MoveUndo undo;
+        make_move(&pos, move, &undo);
+        move_score = ((moves >> move) & 1) ? -minimax(&pos, depth - 1) : -GAME_WON_SCORE - 1;
+        unmake_move(&pos, &undo);
+      }
+      if(score != expected || move_score != expected)
+      {
+        if(mismatches < 10)
+        {
+          printf("  position %d, features %d, depth %d: search %d with move %d scoring %d, minimax %d\n", i,
+                 FEATURES[f], depth, score, move, move_score, expected);
+        }
+        mismatches++;
+      }
+      searches++;
+    }
+  }
+  ai_set_features(AI_FEATURES_ALL);
+  ai_set_depth_limit(0);
+  printf("minimax              %8.2f ms/search  %d of %d scores and moves as plain minimax found (depth 1 to %d)\n",
+         (get_time_ns() - start) / 1e6 / searches, searches - mismatches, searches, MINIMAX_MAX_DEPTH);
+  return mismatches == 0;
+}
+
+// Returns false if any move differs, which means a position or a move got garbled in the messages.
+static bool run_worker_benchmark()
+{
+  int searches = 0;
+  int same_moves = 0;
+  uint64_t local_ns = 0;
+  uint64_t worker_ns = 0;
+  ai_set_depth_limit(s_search_depth);
+  ai_worker_init();
+  for(int i = 0; i < BENCH_POSITIONS && searches < SEARCH_POSITIONS; i += 37)
+  {
+    const Position *pos = &s_positions[i];
+    if(pos->empties < SEARCH_MIN_EMPTIES || pos->empties > SEARCH_MAX_EMPTIES)
+    {
+      continue;
+    }
+    ai_clear();
+    srand((unsigned)BENCH_SEED);
+    uint64_t start = get_time_ns();
+    ai_start_search(pos, 0, 0);
+    while(!ai_continue_search())
+    {
+    }
+    local_ns += get_time_ns() - start;
+    int local_move = ai_get_best_move();
+    ai_clear();
+    srand((unsigned)BENCH_SEED);
+    start = get_time_ns();
+    ai_worker_start_search(pos, 0, 0);
+    while(!ai_worker_continue_search())
+    {
+    }
+    worker_ns += get_time_ns() - start;
+    same_moves += (ai_worker_get_best_move() == local_move);
+    searches++;
+  }
+  ai_worker_deinit();
+  ai_set_depth_limit(0);
+  printf("worker               %8.2f ms/search %8.2f in place  %d of %d moves as searched in place (depth %d)\n",
+         worker_ns / 1e6 / searches, local_ns / 1e6 / searches, same_moves, searches, s_search_depth);
+  return same_moves == searches;
+}
+
+static void load_weights(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    fprintf(stderr, "reversi_bench: can't read %s (%s)\n", path, strerror(errno));
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  s_weights_data = malloc(size);
+  if(s_weights_data == NULL || fread(s_weights_data, 1, size, file) != (size_t)size)
+  {
+    fprintf(stderr, "reversi_bench: can't read %s\n", path);
+    exit(1);
+  }
+  fclose(file);
+  eval_set_data(s_weights_data, size);
+}
+
+// With no names on the command line, everything runs.
+static bool is_selected(const char *name, int argc, char **argv)
+{
+  bool selected = (optind == argc);
+  for(int i = optind; i < argc; i++)
+  {
+    selected = selected || strcmp(argv[i], name) == 0;
+  }
+  return selected;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: reversi_bench [-w weights.bin] [-d search depth] [benchmark...]\n");
+  fprintf(stderr, "  %-20s leaf counts of the move tree, checked against known values\n", PERFT_BENCHMARK);
+  for(int i = 0; i < BENCHMARK_COUNT; i++)
+  {
+    fprintf(stderr, "  %-20s %s\n", BENCHMARKS[i].name, BENCHMARKS[i].description);
+  }
+  for(int i = 0; i < SEARCH_BENCHMARK_COUNT; i++)
+  {
+    fprintf(stderr, "  %-20s %s, %d plies (default %d)\n", SEARCH_BENCHMARKS[i].name, SEARCH_BENCHMARKS[i].description,
+            s_search_depth, DEFAULT_SEARCH_DEPTH);
+  }
+  fprintf(stderr, "  %-20s the last at 1, 2, 4, 8 and 16 threads\n", SMP_BENCHMARK);
+  fprintf(stderr, "  %-20s searches 1 to %d plies deep, checked against plain minimax\n", MINIMAX_CHECK, MINIMAX_MAX_DEPTH);
+  fprintf(stderr, "  %-20s the first through the worker protocol, checked against searching in place\n", WORKER_BENCHMARK);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int option;
+  const char *weights_path = NULL;
+  while((option = getopt(argc, argv, "w:d:")) != -1)
+  {
+    switch(option)
+    {
+      case 'w': weights_path = optarg; break;
+      case 'd': s_search_depth = atoi(optarg); break;
+      default: usage();
+    }
+  }
+  init_zobrist_keys();
+  eval_init();
+  if(weights_path != NULL)
+  {
+    load_weights(weights_path);
+  }
+  else
+  {
+    fprintf(stderr, "reversi_bench: no -w, so eval times the disc counting fallback\n");
+  }
+  eval_set_phase(BOARD_WIDTH*BOARD_HEIGHT / 2);
+  if(s_search_depth < 1)
+  {
+    usage();
+  }
+  make_positions();
+  for(int i = optind; i < argc; i++)
+  {
+    bool found = strcmp(argv[i], SMP_BENCHMARK) == 0 || strcmp(argv[i], PERFT_BENCHMARK) == 0 ||
+                 strcmp(argv[i], WORKER_BENCHMARK) == 0 || strcmp(argv[i], MINIMAX_CHECK) == 0;
+    for(int b = 0; b < BENCHMARK_COUNT; b++)
+    {
+      found = found || strcmp(argv[i], BENCHMARKS[b].name) == 0;
+    }
+    for(int b = 0; b < SEARCH_BENCHMARK_COUNT; b++)
+    {
+      found = found || strcmp(argv[i], SEARCH_BENCHMARKS[b].name) == 0;
+    }
+    if(!found)
+    {
+      usage();
+    }
+  }
+  if(is_selected(PERFT_BENCHMARK, argc, argv) && !run_perft_benchmark())
+  {
+    fprintf(stderr, "reversi_bench: perft counts are wrong\n");
+    return 1;
+  }
+  if(is_selected(MINIMAX_CHECK, argc, argv) && !run_minimax_check())
+  {
+    fprintf(stderr, "reversi_bench: searches disagree with minimax\n");
+    return 1;
+  }
+  for(int b = 0; b < BENCHMARK_COUNT; b++)
+  {
+    if(is_selected(BENCHMARKS[b].name, argc, argv))
+    {
+      run_benchmark(&BENCHMARKS[b]);
+    }
+  }
+  for(int b = 0; b < SEARCH_BENCHMARK_COUNT; b++)
+  {
+    if(is_selected(SEARCH_BENCHMARKS[b].name, argc, argv))
+    {
+      run_search_benchmark(&SEARCH_BENCHMARKS[b]);
+    }
+  }
+  if(is_selected(SMP_BENCHMARK, argc, argv))
+  {
+    run_smp_benchmark();
+  }
+  if(is_selected(WORKER_BENCHMARK, argc, argv) && !run_worker_benchmark())
+  {
+    fprintf(stderr, "reversi_bench: moves through the worker protocol are wrong\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,514 @@
+// Self-play tournament between two engine configurations, to tell a stronger engine from a merely slower one.
+//
+// Every game starts from one of a fixed set of balanced openings: the positions a few plies from the start, told
+// apart up to symmetry, whose fixed-depth search scores are closest to even.  Each opening is played twice, once with
+// each engine as black.  The games run in forked worker processes, one per core.  A move clears the transposition
+// table and loads its engine's evaluation weights, and the process has one of each, so games on threads would trip
+// over each other.  Both engines share a worker, so each move starts from a clear table and history.
+//
+// An engine is a comma separated list of settings:
+//   level=N      a watch difficulty, 0 to 3: its time budget per move and its ProbCut selectivity
+//   ms=N         time budget per move instead
+//   sel=N        ProbCut selectivity instead
+//   depth=N      heuristic searches N plies deep, endgames included: no exact solve near the end, and no time
+//                budget unless one is given
+//   features=N   search feature bits, see ai.h
+//   weights=F    evaluation weights instead of -w's
+//
+//   make -C tools tournament
+//   tools/tournament -w resources/eval_weights.bin -a level=2 -b level=2,weights=new_weights.bin -g 2000
+#include "platform.h"
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "util.h"
+#include "game.h"
+#include "ai.h"
+#include "eval.h"
+#include "book.h"
+
+#define MAX_JOBS 256
+#define MAX_OPENINGS 8192
+#define OPENING_DEPTH 6 //Search depth the openings are scored at.
+#define DEFAULT_OPENING_PLIES 6
+#define DEFAULT_GAMES 1000
+#define ENGINE_COUNT 2
+
+typedef struct {
+  const char *spec;
+  int level; //-1 if not given.
+  int budget_ms;
+  int selectivity; //-1 if not given.
+  int depth;
+  int features;
+  const char *weights_path;
+  uint8_t *weights_data;
+  size_t weights_size;
+} Engine;
+
+typedef struct {
+  uint64_t hash; //Canonical, see book_get_canonical_hash.
+  Position pos;
+  int score; //For the side to move.
+} Opening;
+
+//What a worker reports for one game.  Small enough for one atomic pipe write, so every worker can share a pipe.
+typedef struct {
+  int32_t game;
+  int16_t margin; //Engine A's discs less engine B's.
+  uint8_t move_count;
+  uint8_t move_engine[BOARD_WIDTH*BOARD_HEIGHT]; //Which engine made each move.
+  uint32_t move_us[BOARD_WIDTH*BOARD_HEIGHT];
+  uint64_t nodes[ENGINE_COUNT];
+} GameRecord;
+
+static Engine s_engines[ENGINE_COUNT];
+static Opening s_openings[MAX_OPENINGS];
+static int s_opening_count;
+static int s_opening_plies = DEFAULT_OPENING_PLIES;
+static int s_game_count = DEFAULT_GAMES;
+static int s_job_count;
+static unsigned s_seed;
+static const char *s_weights_path;
+
+//Per engine totals over the whole tournament.
+static uint32_t *s_move_us[ENGINE_COUNT];
+static int s_moves[ENGINE_COUNT];
+static uint64_t s_nodes[ENGINE_COUNT];
+static uint64_t s_search_us[ENGINE_COUNT];
+
+static void die(const char *message)
+{
+  fprintf(stderr, "tournament: %s (%s)\n", message, strerror(errno));
+  exit(1);
+}
+
+static uint64_t get_time_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static void load_weights(const char *path, uint8_t **data, size_t *size)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    die("can't read weights");
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  *data = malloc(length);
+  if(*data == NULL || fread(*data, 1, length, file) != (size_t)length)
+  {
+    die("can't read weights");
+  }
+  fclose(file);
+  *size = length;
+}
+
+// Fills in an engine from its settings.  Returns false if they don't make sense.
+static bool parse_engine(const char *spec, Engine *engine)
+{
+  engine->spec = spec;
+  engine->level = -1;
+  engine->budget_ms = 0;
+  engine->selectivity = -1;
+  engine->depth = 0;
+  engine->features = AI_FEATURES_ALL;
+  engine->weights_path = NULL;
+  char *settings = strdup(spec);
+  char *rest = NULL;
+  for(char *setting = strtok_r(settings, ",", &rest); setting != NULL; setting = strtok_r(NULL, ",", &rest))
+  {
+    char *value = strchr(setting, '=');
+    if(value == NULL)
+    {
+      return false;
+    }
+    *value++ = '\0';
+    if(strcmp(setting, "level") == 0)
+    {
+      engine->level = atoi(value);
+    }
+    else if(strcmp(setting, "ms") == 0)
+    {
+      engine->budget_ms = atoi(value);
+    }
+    else if(strcmp(setting, "sel") == 0)
+    {
+      engine->selectivity = atoi(value);
+    }
+    else if(strcmp(setting, "depth") == 0)
+    {
+      engine->depth = atoi(value);
+    }
+    else if(strcmp(setting, "features") == 0)
+    {
+      engine->features = atoi(value);
+    }
+    else if(strcmp(setting, "weights") == 0)
+    {
+      engine->weights_path = value;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  //Something has to end each search.
+  return engine->level >= 0 || engine->budget_ms > 0 || engine->depth > 0;
+}
+
+static int get_budget_ms(const Engine *engine, int empties)
+{
+  if(engine->budget_ms > 0 || engine->level < 0)
+  {
+    return engine->budget_ms;
+  }
+  return get_move_budget_ms(engine->level, empties);
+}
+
+static int get_selectivity(const Engine *engine)
+{
+  if(engine->selectivity >= 0 || engine->level < 0)
+  {
+    return max(engine->selectivity, 0);
+  }
+  return get_move_selectivity(engine->level);
+}
+
+// Runs a whole search for the side to move with the engine's settings.  Returns its move, and the search's nodes and
+// time in microseconds, which leave out clearing the table beforehand.
+static int search(const Engine *engine, const Position *pos, uint32_t *nodes, uint32_t *elapsed_us)
+{
+  eval_set_data(engine->weights_data, engine->weights_size);
+  ai_set_features(engine->features);
+  ai_set_depth_limit(engine->depth);
+  ai_clear();
+  uint64_t start = get_time_us();
+  ai_start_search(pos, get_budget_ms(engine, pos->empties), get_selectivity(engine));
+  while(!ai_continue_search())
+  {
+  }
+  *elapsed_us = (uint32_t)(get_time_us() - start);
+  *nodes = ai_get_search_nodes();
+  return ai_get_best_move();
+}
+
+static void add_opening(const Position *pos)
+{
+  int symmetry = 0;
+  uint64_t hash = book_get_canonical_hash(pos, &symmetry);
+  for(int i = 0; i < s_opening_count; i++)
+  {
+    if(s_openings[i].hash == hash)
+    {
+      return;
+    }
+  }
+  if(s_opening_count == MAX_OPENINGS)
+  {
+    fprintf(stderr, "tournament: more than %d openings, so some are left out\n", MAX_OPENINGS);
+    return;
+  }
+  s_openings[s_opening_count].hash = hash;
+  s_openings[s_opening_count].pos = *pos;
+  s_opening_count++;
+}
+
+static void find_openings(Position *pos, int plies)
+{
+  uint64_t moves = 0;
+  int status = get_move_status(pos, &moves);
+  if(plies == 0 || status != MOVES_AVAILABLE)
+  {
+    if(status == MOVES_AVAILABLE)
+    {
+      add_opening(pos);
+    }
+    return;
+  }
+  MoveUndo undo;
+  for(; moves != 0; moves &= moves - 1)
+  {
+    make_move(pos, __builtin_ctzll(moves), &undo);
+    find_openings(pos, plies - 1);
+    unmake_move(pos, &undo);
+  }
+}
+
+// Closest to even first, then by hash, so the same options always pick the same openings.
+static int compare_openings(const void *a, const void *b)
+{
+  const Opening *first = a;
+  const Opening *second = b;
+  if(abs(first->score) != abs(second->score))
+  {
+    return abs(first->score) - abs(second->score);
+  }
+  return (first->hash < second->hash) ? -1 : (first->hash > second->hash);
+}
+
+static void choose_openings()
+{
+  char board[BOARD_WIDTH*BOARD_HEIGHT];
+  memset(board, EMPTY, sizeof(board));
+  board[get_board_index(3, 3)] = WHITE;
+  board[get_board_index(4, 4)] = WHITE;
+  board[get_board_index(4, 3)] = BLACK;
+  board[get_board_index(3, 4)] = BLACK;
+  Position start;
+  board_to_position(board, 0, &start);
+  find_openings(&start, s_opening_plies);
+  Engine scorer = {NULL, -1, 0, 0, OPENING_DEPTH, AI_FEATURES_ALL, s_weights_path, NULL, 0};
+  if(s_weights_path != NULL)
+  {
+    load_weights(s_weights_path, &scorer.weights_data, &scorer.weights_size);
+  }
+  for(int i = 0; i < s_opening_count; i++)
+  {
+    uint32_t nodes = 0;
+    uint32_t elapsed = 0;
+    srand(s_seed);
+    search(&scorer, &s_openings[i].pos, &nodes, &elapsed);
+    s_openings[i].score = ai_get_search_score();
+  }
+  qsort(s_openings, s_opening_count, sizeof(Opening), compare_openings);
+  free(scorer.weights_data);
+  //Each opening is played twice, so half as many as games are needed.
+  s_opening_count = min(s_opening_count, (s_game_count + 1) / 2);
+  fprintf(stderr, "%d openings %d plies deep, all within %.2f discs of even at depth %d\n", s_opening_count,
+          s_opening_plies, (double)abs(s_openings[s_opening_count - 1].score) / EVAL_SCALE, OPENING_DEPTH);
+}
+
+// Game 2n and 2n+1 both start from opening n, with engine A black in the first and white in the second.
+static void play_game(int game, GameRecord *record)
+{
+  Position pos = s_openings[(game / 2) % s_opening_count].pos;
+  int black_engine = game & 1;
+  memset(record, 0, sizeof(GameRecord));
+  record->game = game;
+  srand(s_seed + game);
+  while(true)
+  {
+    uint64_t moves = 0;
+    int status = get_move_status(&pos, &moves);
+    MoveUndo undo;
+    if(status == MOVES_GAME_OVER)
+    {
+      break;
+    }
+    if(status == MOVES_MUST_PASS)
+    {
+      make_move(&pos, PASS_MOVE, &undo);
+      continue;
+    }
+    int engine = (pos.player == 0) ? black_engine : 1 - black_engine;
+    uint32_t nodes = 0;
+    uint32_t elapsed = 0;
+    int move = search(&s_engines[engine], &pos, &nodes, &elapsed);
+    if(move < 0 || !(moves & (1ULL << move)))
+    {
+      fprintf(stderr, "tournament: engine %c played illegal move %d in game %d\n", 'A' + engine, move, game);
+      _exit(1);
+    }
+    record->move_engine[record->move_count] = engine;
+    record->move_us[record->move_count] = elapsed;
+    record->move_count++;
+    record->nodes[engine] += nodes;
+    make_move(&pos, move, &undo);
+  }
+  int a_player = black_engine;
+  record->margin = pos.disc_count[a_player] - pos.disc_count[1 - a_player];
+}
+
+static void run_worker(int worker, int reply_fd)
+{
+  for(int game = worker; game < s_game_count; game += s_job_count)
+  {
+    GameRecord record;
+    play_game(game, &record);
+    if(write(reply_fd, &record, sizeof(record)) != sizeof(record))
+    {
+      _exit(1);
+    }
+  }
+  _exit(0);
+}
+
+static void add_record(const GameRecord *record)
+{
+  for(int i = 0; i < record->move_count; i++)
+  {
+    int engine = record->move_engine[i];
+    s_move_us[engine][s_moves[engine]++] = record->move_us[i];
+    s_search_us[engine] += record->move_us[i];
+  }
+  for(int engine = 0; engine < ENGINE_COUNT; engine++)
+  {
+    s_nodes[engine] += record->nodes[engine];
+  }
+}
+
+static double get_elo(double score)
+{
+  score = fmin(fmax(score, 1e-6), 1 - 1e-6);
+  return -400 * log10(1 / score - 1);
+}
+
+static int compare_times(const void *a, const void *b)
+{
+  uint32_t first = *(const uint32_t *)a;
+  uint32_t second = *(const uint32_t *)b;
+  return (first > second) - (first < second);
+}
+
+static void report(int wins, int draws, int losses, uint32_t elapsed_ms)
+{
+  int games = wins + draws + losses;
+  double score = (wins + draws * 0.5) / games;
+  //95% interval from the spread of the game scores themselves.
+  double variance = (wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score) + losses * score * score) / games;
+  double margin = 1.96 * sqrt(variance / games);
+  printf("A: %s\nB: %s\n", s_engines[0].spec, s_engines[1].spec);
+  printf("%d games in %.1f s: A %d wins, %d draws, %d losses, score %.1f%%\n", games, elapsed_ms / 1000.0, wins, draws, losses,
+         100 * score);
+  printf("Elo of A over B: %+.1f (95%% interval %+.1f to %+.1f)\n", get_elo(score), get_elo(score - margin),
+         get_elo(score + margin));
+  for(int engine = 0; engine < ENGINE_COUNT; engine++)
+  {
+    int moves = s_moves[engine];
+    qsort(s_move_us[engine], moves, sizeof(uint32_t), compare_times);
+    uint32_t p95 = (moves > 0) ? s_move_us[engine][(moves * 95 + 99) / 100 - 1] : 0;
+    printf("%c: %d moves, %.1f ms/move mean, %.1f ms p95, %.0f knodes/s\n", 'A' + engine, moves,
+           (moves > 0) ? s_search_us[engine] / 1000.0 / moves : 0, p95 / 1000.0,
+           (s_search_us[engine] > 0) ? s_nodes[engine] * 1000.0 / s_search_us[engine] : 0);
+  }
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: tournament [options] -a engine -b engine\n"
+          "  -a settings  engine A, such as level=2 or ms=100,sel=3,weights=file (see tournament.c)\n"
+          "  -b settings  engine B\n"
+          "               depth=N searches N plies deep to the end of the game, with no exact endgame solve\n"
+          "  -w file      evaluation weights for both engines and the opening scores (default: disc counting)\n"
+          "  -g count     games, half with each engine as black (default %d)\n"
+          "  -p plies     opening length (default %d)\n"
+          "  -j jobs      worker processes (default: one per core)\n"
+          "  -S seed      random seed for tie breaks (default 1)\n",
+          DEFAULT_GAMES, DEFAULT_OPENING_PLIES);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  int option;
+  const char *specs[ENGINE_COUNT] = {NULL, NULL};
+  s_job_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  s_seed = 1;
+  while((option = getopt(argc, argv, "a:b:w:g:p:j:S:")) != -1)
+  {
+    switch(option)
+    {
+      case 'a': specs[0] = optarg; break;
+      case 'b': specs[1] = optarg; break;
+      case 'w': s_weights_path = optarg; break;
+      case 'g': s_game_count = atoi(optarg); break;
+      case 'p': s_opening_plies = atoi(optarg); break;
+      case 'j': s_job_count = atoi(optarg); break;
+      case 'S': s_seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      default: usage();
+    }
+  }
+  for(int engine = 0; engine < ENGINE_COUNT; engine++)
+  {
+    if(specs[engine] == NULL || !parse_engine(specs[engine], &s_engines[engine]))
+    {
+      usage();
+    }
+  }
+  if(s_game_count < 1 || s_opening_plies < 1)
+  {
+    usage();
+  }
+  s_job_count = min(max(s_job_count, 1), min(MAX_JOBS, s_game_count));
+  init_zobrist_keys();
+  eval_init();
+  for(int engine = 0; engine < ENGINE_COUNT; engine++)
+  {
+    Engine *settings = &s_engines[engine];
+    if(settings->weights_path == NULL)
+    {
+      settings->weights_path = s_weights_path;
+    }
+    if(settings->weights_path != NULL)
+    {
+      load_weights(settings->weights_path, &settings->weights_data, &settings->weights_size);
+    }
+    s_move_us[engine] = malloc(sizeof(uint32_t) * s_game_count * BOARD_WIDTH*BOARD_HEIGHT);
+    if(s_move_us[engine] == NULL)
+    {
+      die("out of memory");
+    }
+  }
+  choose_openings();
+
+  uint32_t start_ms = get_time_ms();
+  int replies[2];
+  if(pipe(replies) != 0)
+  {
+    die("can't create worker pipe");
+  }
+  for(int i = 0; i < s_job_count; i++)
+  {
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+      die("can't start worker");
+    }
+    if(pid == 0)
+    {
+      close(replies[0]);
+      run_worker(i, replies[1]);
+    }
+  }
+  close(replies[1]);
+  int wins = 0;
+  int draws = 0;
+  int losses = 0;
+  GameRecord record;
+  while(read(replies[0], &record, sizeof(record)) == sizeof(record))
+  {
+    add_record(&record);
+    wins += (record.margin > 0);
+    draws += (record.margin == 0);
+    losses += (record.margin < 0);
+    int played = wins + draws + losses;
+    if(played % 100 == 0 && played < s_game_count)
+    {
+      fprintf(stderr, "%d games, A %d wins, %d draws, %d losses\n", played, wins, draws, losses);
+    }
+  }
+  bool failed = false;
+  for(int i = 0; i < s_job_count; i++)
+  {
+    int status = 0;
+    wait(&status);
+    failed = failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  if(failed || wins + draws + losses != s_game_count)
+  {
+    fprintf(stderr, "tournament: a worker failed, so only %d of %d games were played\n", wins + draws + losses, s_game_count);
+  }
+  if(wins + draws + losses > 0)
+  {
+    report(wins, draws, losses, get_time_ms() - start_ms);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#include <pebble_worker.h>
+#include <stdlib.h>
+#include "util.h"
+#include "game.h"
+#include "eval.h"
+#include "ai_worker.h"
+
+//The background worker.  It searches the positions the app sends it and sends back its moves (see ai_worker.h).
+//It's built from the same engine sources as the app, with REVERSI_WORKER defined.
+
+static void init(void) {
+  srand(time(NULL));
+  init_zobrist_keys();
+  eval_init();
+  ai_worker_serve();
+}
+
+static void deinit(void) {
+  app_worker_message_unsubscribe();
+}
+
+int main(void) {
+  init();
+  worker_event_loop();
+  deinit();
+}